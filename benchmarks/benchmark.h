@@ -0,0 +1,109 @@
+// Copyright (c) 2015, the scalloc project authors.  All rights reserved.
+// Please see the AUTHORS file for details.  Use of this source code is governed
+// by a BSD license that can be found in the LICENSE file.
+
+// Helpers shared by the allocator benchmarks. Benchmarks link against the
+// system allocator and are run against scalloc by preloading it, see
+// tools/run_benchmarks.sh.
+
+#ifndef SCALLOC_BENCHMARKS_BENCHMARK_H_
+#define SCALLOC_BENCHMARKS_BENCHMARK_H_
+
+#include <stdint.h>
+#include <stdio.h>
+#include <sys/resource.h>
+#include <sys/time.h>
+#include <unistd.h>
+
+#include <atomic>
+
+namespace benchmark {
+
+inline uint64_t NowUs() {
+  struct timeval tv;
+  gettimeofday(&tv, nullptr);
+  return static_cast<uint64_t>(tv.tv_sec) * 1000000 + tv.tv_usec;
+}
+
+
+// Peak resident set size of the process in KiB.
+inline uint64_t PeakRssKb() {
+  struct rusage usage;
+  if (getrusage(RUSAGE_SELF, &usage) != 0) {
+    return 0;
+  }
+  return usage.ru_maxrss;
+}
+
+
+// Current resident set size of the process in KiB.
+inline uint64_t RssKb() {
+  FILE* f = fopen("/proc/self/statm", "r");
+  if (f == nullptr) {
+    return 0;
+  }
+  uint64_t size = 0;
+  uint64_t resident = 0;
+  if (fscanf(f, "%lu %lu", &size, &resident) != 2) {
+    resident = 0;
+  }
+  fclose(f);
+  return resident * (sysconf(_SC_PAGESIZE) / 1024);
+}
+
+
+// Prints the result line parsed by tools/run_benchmarks.sh.
+inline void Report(const char* name,
+                   double ops,
+                   uint64_t duration_us,
+                   uint64_t peak_rss_kb) {
+  printf("%s: time: %.3f s, throughput: %.2f Mops/s, peak rss: %lu KiB\n",
+         name, duration_us / 1e6, ops / duration_us, peak_rss_kb);
+}
+
+
+inline void Report(const char* name, double ops, uint64_t duration_us) {
+  Report(name, ops, duration_us, PeakRssKb());
+}
+
+
+// Lets all threads of a benchmark start at the same time.
+class StartBarrier {
+ public:
+  explicit StartBarrier(int threads) : threads_(threads), arrived_(0) {}
+
+  void Wait() {
+    arrived_.fetch_add(1);
+    while (arrived_.load() < threads_) {}
+  }
+
+ private:
+  const int threads_;
+  std::atomic<int> arrived_;
+};
+
+
+// Cheap thread-local random numbers (xorshift), as rand() serializes threads.
+class Random {
+ public:
+  explicit Random(uint64_t seed) : state_(seed * 0x9e3779b97f4a7c15UL + 1) {}
+
+  uint64_t Next() {
+    state_ ^= state_ << 13;
+    state_ ^= state_ >> 7;
+    state_ ^= state_ << 17;
+    return state_;
+  }
+
+  // Returns a number in [min, max].
+  uint64_t Range(uint64_t min, uint64_t max) {
+    return min + (Next() % (max - min + 1));
+  }
+
+ private:
+  uint64_t state_;
+};
+
+}  // namespace benchmark
+
+#endif  // SCALLOC_BENCHMARKS_BENCHMARK_H_
@@ -0,0 +1,79 @@
+// Copyright (c) 2015, the scalloc project authors.  All rights reserved.
+// Please see the AUTHORS file for details.  Use of this source code is governed
+// by a BSD license that can be found in the LICENSE file.
+
+// cache-thrash (from the Hoard benchmarks): Each thread repeatedly allocates a
+// small object, writes it many times, and frees it. An allocator that hands
+// objects of the same cache line to different threads causes active false
+// sharing, which shows as time growing with the number of threads. Throughput
+// counts writes.
+//
+// Usage: cache_thrash [threads] [iterations] [repetitions] [object size]
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <thread>
+#include <vector>
+
+#include "benchmark.h"
+
+namespace {
+
+int num_threads = 4;
+int iterations = 1000;
+int repetitions = 100000;
+size_t object_size = 8;
+
+benchmark::StartBarrier* barrier;
+
+
+void Worker() {
+  barrier->Wait();
+  for (int i = 0; i < iterations; i++) {
+    volatile char* obj = static_cast<volatile char*>(malloc(object_size));
+    for (int r = 0; r < repetitions; r++) {
+      for (size_t j = 0; j < object_size; j++) {
+        obj[j] = obj[j] + 1;
+      }
+    }
+    free(const_cast<char*>(obj));
+  }
+}
+
+}  // namespace
+
+
+int main(int argc, char** argv) {
+  if (argc > 1) { num_threads = atoi(argv[1]); }
+  if (argc > 2) { iterations = atoi(argv[2]); }
+  if (argc > 3) { repetitions = atoi(argv[3]); }
+  if (argc > 4) { object_size = atol(argv[4]); }
+  if ((num_threads < 1) || (iterations < 1) || (repetitions < 1) ||
+      (object_size < 1)) {
+    fprintf(stderr, "usage: %s [threads] [iterations] [repetitions] "
+            "[object size]\n", argv[0]);
+    return EXIT_FAILURE;
+  }
+
+  barrier = new benchmark::StartBarrier(num_threads);
+  const uint64_t start = benchmark::NowUs();
+  std::vector<std::thread> threads;
+  for (int i = 0; i < num_threads; i++) {
+    threads.push_back(std::thread(Worker));
+  }
+  for (auto& t : threads) {
+    t.join();
+  }
+  const uint64_t duration = benchmark::NowUs() - start;
+
+  const double ops =
+      static_cast<double>(num_threads) * iterations * repetitions * object_size;
+  printf("cache_thrash: threads: %d, iterations: %d, repetitions: %d, "
+         "size: %lu\n", num_threads, iterations, repetitions, object_size);
+  benchmark::Report("cache_thrash", ops, duration);
+
+  delete barrier;
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,97 @@
+// Copyright (c) 2015, the scalloc project authors.  All rights reserved.
+// Please see the AUTHORS file for details.  Use of this source code is governed
+// by a BSD license that can be found in the LICENSE file.
+
+// larson (after Larson and Krishnan, "Memory allocation for long-running
+// server applications"): Each thread owns a set of slots holding objects of
+// random sizes and repeatedly replaces the object in a random slot. After a
+// number of replacements a thread terminates and hands its slots over to a
+// newly created thread, which thus frees objects allocated by its
+// predecessor, i.e., remote frees to spans of terminated threads.
+//
+// Usage: larson [threads] [generations] [rounds] [slots] [min size] [max size]
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <thread>
+#include <vector>
+
+#include "benchmark.h"
+
+namespace {
+
+int num_threads = 4;
+int generations = 100;
+int rounds = 100000;
+int num_slots = 1000;
+size_t min_size = 8;
+size_t max_size = 1000;
+
+
+void Generation(void** slots, int id, int generation) {
+  benchmark::Random rand(static_cast<uint64_t>(id) * generations + generation);
+  for (int i = 0; i < rounds; i++) {
+    const int victim = rand.Next() % num_slots;
+    free(slots[victim]);
+    const size_t size = rand.Range(min_size, max_size);
+    slots[victim] = malloc(size);
+    memset(slots[victim], i, size < 64 ? size : 64);
+  }
+}
+
+
+// Runs the generations of a slot set one after the other, each in a new
+// thread.
+void Lineage(int id) {
+  void** slots = static_cast<void**>(malloc(num_slots * sizeof(void*)));
+  benchmark::Random rand(id);
+  for (int i = 0; i < num_slots; i++) {
+    slots[i] = malloc(rand.Range(min_size, max_size));
+  }
+  for (int g = 0; g < generations; g++) {
+    std::thread t(Generation, slots, id, g);
+    t.join();
+  }
+  for (int i = 0; i < num_slots; i++) {
+    free(slots[i]);
+  }
+  free(slots);
+}
+
+}  // namespace
+
+
+int main(int argc, char** argv) {
+  if (argc > 1) { num_threads = atoi(argv[1]); }
+  if (argc > 2) { generations = atoi(argv[2]); }
+  if (argc > 3) { rounds = atoi(argv[3]); }
+  if (argc > 4) { num_slots = atoi(argv[4]); }
+  if (argc > 5) { min_size = atol(argv[5]); }
+  if (argc > 6) { max_size = atol(argv[6]); }
+  if ((num_threads < 1) || (generations < 1) || (rounds < 1) ||
+      (num_slots < 1) || (min_size < 1) || (max_size < min_size)) {
+    fprintf(stderr, "usage: %s [threads] [generations] [rounds] [slots] "
+            "[min size] [max size]\n", argv[0]);
+    return EXIT_FAILURE;
+  }
+
+  const uint64_t start = benchmark::NowUs();
+  std::vector<std::thread> threads;
+  for (int i = 0; i < num_threads; i++) {
+    threads.push_back(std::thread(Lineage, i));
+  }
+  for (auto& t : threads) {
+    t.join();
+  }
+  const uint64_t duration = benchmark::NowUs() - start;
+
+  const double ops = 2.0 * num_threads * generations * rounds;
+  printf("larson: threads: %d, generations: %d, rounds: %d, slots: %d, "
+         "size: %lu-%lu\n",
+         num_threads, generations, rounds, num_slots, min_size, max_size);
+  benchmark::Report("larson", ops, duration);
+  return EXIT_SUCCESS;
+}
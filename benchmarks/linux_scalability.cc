@@ -0,0 +1,70 @@
+// Copyright (c) 2015, the scalloc project authors.  All rights reserved.
+// Please see the AUTHORS file for details.  Use of this source code is governed
+// by a BSD license that can be found in the LICENSE file.
+
+// linux-scalability (after Lever and Boreham, "malloc() Performance in a
+// Multithreaded Linux Environment"): Each thread allocates and immediately
+// frees objects of a fixed size in a tight loop. Measures the raw fast paths
+// and how they scale, as threads share no memory at all.
+//
+// Usage: linux_scalability [threads] [iterations] [object size]
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <thread>
+#include <vector>
+
+#include "benchmark.h"
+
+namespace {
+
+int num_threads = 4;
+int iterations = 100000000;
+size_t object_size = 512;
+
+benchmark::StartBarrier* barrier;
+
+
+void Worker() {
+  barrier->Wait();
+  for (int i = 0; i < iterations; i++) {
+    volatile char* obj = static_cast<volatile char*>(malloc(object_size));
+    obj[0] = static_cast<char>(i);
+    free(const_cast<char*>(obj));
+  }
+}
+
+}  // namespace
+
+
+int main(int argc, char** argv) {
+  if (argc > 1) { num_threads = atoi(argv[1]); }
+  if (argc > 2) { iterations = atoi(argv[2]); }
+  if (argc > 3) { object_size = atol(argv[3]); }
+  if ((num_threads < 1) || (iterations < 1) || (object_size < 1)) {
+    fprintf(stderr, "usage: %s [threads] [iterations] [object size]\n",
+            argv[0]);
+    return EXIT_FAILURE;
+  }
+
+  barrier = new benchmark::StartBarrier(num_threads);
+  const uint64_t start = benchmark::NowUs();
+  std::vector<std::thread> threads;
+  for (int i = 0; i < num_threads; i++) {
+    threads.push_back(std::thread(Worker));
+  }
+  for (auto& t : threads) {
+    t.join();
+  }
+  const uint64_t duration = benchmark::NowUs() - start;
+
+  const double ops = 2.0 * num_threads * iterations;
+  printf("linux_scalability: threads: %d, iterations: %d, size: %lu\n",
+         num_threads, iterations, object_size);
+  benchmark::Report("linux_scalability", ops, duration);
+
+  delete barrier;
+  return EXIT_SUCCESS;
+}
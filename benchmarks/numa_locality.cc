@@ -0,0 +1,173 @@
+// Copyright (c) 2015, the scalloc project authors.  All rights reserved.
+// Please see the AUTHORS file for details.  Use of this source code is governed
+// by a BSD license that can be found in the LICENSE file.
+
+// Measures how often threads get memory from a remote NUMA node. Threads are
+// pinned round-robin to CPUs and arranged in a ring: Each thread allocates a
+// batch of objects, touches them, hands the batch to its successor, and frees
+// the batch handed in by its predecessor. Spans thus get emptied by threads on
+// other nodes and travel through the span pool. For every allocated object the
+// benchmark queries the node backing it and reports the ratio of objects on a
+// node other than the one of the allocating thread.
+//
+// Usage: numa_locality [threads] [rounds] [batch] [object size]
+
+#include <sched.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include <atomic>
+#include <thread>
+#include <vector>
+
+#include "benchmark.h"
+
+namespace {
+
+struct Mailbox {
+  std::atomic<void**> batch;
+  char pad[64 - sizeof(std::atomic<void**>)];
+};
+
+int num_threads;
+int rounds = 200;
+int batch_size = 1024;
+size_t object_size = 4096;
+
+Mailbox* mailboxes;
+std::atomic<int> ready;
+std::atomic<uint64_t> local_objects;
+std::atomic<uint64_t> remote_objects;
+std::atomic<uint64_t> unknown_objects;
+
+
+int CurrentNode() {
+  unsigned int node = 0;
+  syscall(SYS_getcpu, nullptr, &node, nullptr);
+  return static_cast<int>(node);
+}
+
+
+// Counts objects of a batch by the node they are placed on, relative to the
+// given node.
+void ClassifyBatch(void** batch, int node) {
+  std::vector<int> status(batch_size);
+  if (syscall(SYS_move_pages, 0, batch_size, batch, nullptr, status.data(),
+              0) != 0) {
+    unknown_objects.fetch_add(batch_size);
+    return;
+  }
+  uint64_t local = 0;
+  uint64_t remote = 0;
+  uint64_t unknown = 0;
+  for (int i = 0; i < batch_size; i++) {
+    if (status[i] < 0) {
+      unknown++;
+    } else if (status[i] == node) {
+      local++;
+    } else {
+      remote++;
+    }
+  }
+  local_objects.fetch_add(local);
+  remote_objects.fetch_add(remote);
+  unknown_objects.fetch_add(unknown);
+}
+
+
+void** AllocateBatch() {
+  void** batch = static_cast<void**>(malloc(batch_size * sizeof(void*)));
+  for (int i = 0; i < batch_size; i++) {
+    batch[i] = malloc(object_size);
+    memset(batch[i], i, object_size);
+  }
+  return batch;
+}
+
+
+void FreeBatch(void** batch) {
+  for (int i = 0; i < batch_size; i++) {
+    free(batch[i]);
+  }
+  free(batch);
+}
+
+
+void Worker(int id) {
+  cpu_set_t set;
+  CPU_ZERO(&set);
+  CPU_SET(id % sysconf(_SC_NPROCESSORS_ONLN), &set);
+  sched_setaffinity(0, sizeof(set), &set);
+
+  Mailbox* out = &mailboxes[(id + 1) % num_threads];
+  Mailbox* in = &mailboxes[id];
+
+  ready.fetch_add(1);
+  while (ready.load() != num_threads) {}
+
+  const int node = CurrentNode();
+  for (int r = 0; r < rounds; r++) {
+    void** batch = AllocateBatch();
+    ClassifyBatch(batch, node);
+    void** expected = nullptr;
+    while (!out->batch.compare_exchange_weak(expected, batch)) {
+      expected = nullptr;
+      std::this_thread::yield();
+    }
+    void** received;
+    while ((received = in->batch.exchange(nullptr)) == nullptr) {
+      std::this_thread::yield();
+    }
+    FreeBatch(received);
+  }
+}
+
+}  // namespace
+
+
+int main(int argc, char** argv) {
+  num_threads = static_cast<int>(sysconf(_SC_NPROCESSORS_ONLN));
+  if (argc > 1) { num_threads = atoi(argv[1]); }
+  if (argc > 2) { rounds = atoi(argv[2]); }
+  if (argc > 3) { batch_size = atoi(argv[3]); }
+  if (argc > 4) { object_size = atol(argv[4]); }
+  if ((num_threads < 2) || (rounds < 1) || (batch_size < 1)) {
+    fprintf(stderr, "usage: %s [threads] [rounds] [batch] [object size]\n",
+            argv[0]);
+    return EXIT_FAILURE;
+  }
+
+  mailboxes = new Mailbox[num_threads];
+  for (int i = 0; i < num_threads; i++) {
+    mailboxes[i].batch.store(nullptr);
+  }
+
+  const uint64_t start = benchmark::NowUs();
+  std::vector<std::thread> threads;
+  for (int i = 0; i < num_threads; i++) {
+    threads.push_back(std::thread(Worker, i));
+  }
+  for (auto& t : threads) {
+    t.join();
+  }
+  const uint64_t duration = benchmark::NowUs() - start;
+
+  const uint64_t local = local_objects.load();
+  const uint64_t remote = remote_objects.load();
+  printf("numa_locality: threads: %d, rounds: %d, batch: %d, size: %lu\n",
+         num_threads, rounds, batch_size, object_size);
+  printf("numa_locality: time: %.3f s, local: %lu, remote: %lu, unknown: %lu, "
+         "remote ratio: %.4f\n",
+         duration / 1e6, local, remote, unknown_objects.load(),
+         (local + remote) ? static_cast<double>(remote) / (local + remote) : 0);
+  benchmark::Report("numa_locality",
+                    2.0 * num_threads * rounds * batch_size,
+                    duration);
+
+  delete[] mailboxes;
+  return EXIT_SUCCESS;
+}
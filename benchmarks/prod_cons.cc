@@ -0,0 +1,125 @@
+// Copyright (c) 2015, the scalloc project authors.  All rights reserved.
+// Please see the AUTHORS file for details.  Use of this source code is governed
+// by a BSD license that can be found in the LICENSE file.
+
+// Producer/consumer: Threads are paired up. The producer of a pair allocates
+// objects of random sizes and passes them through a bounded queue to the
+// consumer, which frees them. All frees are thus remote frees, and memory
+// only flows from producers to consumers.
+//
+// Usage: prod_cons [pairs] [objects] [queue size] [min size] [max size]
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <atomic>
+#include <thread>
+#include <vector>
+
+#include "benchmark.h"
+
+namespace {
+
+int num_pairs = 2;
+int num_objects = 10000000;
+int queue_size = 1024;
+size_t min_size = 8;
+size_t max_size = 256;
+
+
+// Single-producer/single-consumer ring buffer.
+class Queue {
+ public:
+  explicit Queue(int size)
+      : size_(size), slots_(new void*[size]), head_(0), tail_(0) {}
+  ~Queue() { delete[] slots_; }
+
+  void Put(void* p) {
+    const uint64_t tail = tail_.load(std::memory_order_relaxed);
+    while ((tail - head_.load(std::memory_order_acquire)) ==
+           static_cast<uint64_t>(size_)) {
+      std::this_thread::yield();
+    }
+    slots_[tail % size_] = p;
+    tail_.store(tail + 1, std::memory_order_release);
+  }
+
+  void* Get() {
+    const uint64_t head = head_.load(std::memory_order_relaxed);
+    while (tail_.load(std::memory_order_acquire) == head) {
+      std::this_thread::yield();
+    }
+    void* p = slots_[head % size_];
+    head_.store(head + 1, std::memory_order_release);
+    return p;
+  }
+
+ private:
+  const int size_;
+  void** const slots_;
+  alignas(64) std::atomic<uint64_t> head_;
+  alignas(64) std::atomic<uint64_t> tail_;
+};
+
+
+void Producer(Queue* queue, int id) {
+  benchmark::Random rand(id);
+  for (int i = 0; i < num_objects; i++) {
+    const size_t size = rand.Range(min_size, max_size);
+    void* p = malloc(size);
+    memset(p, i, size < 16 ? size : 16);
+    queue->Put(p);
+  }
+}
+
+
+void Consumer(Queue* queue) {
+  for (int i = 0; i < num_objects; i++) {
+    free(queue->Get());
+  }
+}
+
+}  // namespace
+
+
+int main(int argc, char** argv) {
+  if (argc > 1) { num_pairs = atoi(argv[1]); }
+  if (argc > 2) { num_objects = atoi(argv[2]); }
+  if (argc > 3) { queue_size = atoi(argv[3]); }
+  if (argc > 4) { min_size = atol(argv[4]); }
+  if (argc > 5) { max_size = atol(argv[5]); }
+  if ((num_pairs < 1) || (num_objects < 1) || (queue_size < 1) ||
+      (min_size < 1) || (max_size < min_size)) {
+    fprintf(stderr, "usage: %s [pairs] [objects] [queue size] [min size] "
+            "[max size]\n", argv[0]);
+    return EXIT_FAILURE;
+  }
+
+  std::vector<Queue*> queues;
+  for (int i = 0; i < num_pairs; i++) {
+    queues.push_back(new Queue(queue_size));
+  }
+
+  const uint64_t start = benchmark::NowUs();
+  std::vector<std::thread> threads;
+  for (int i = 0; i < num_pairs; i++) {
+    threads.push_back(std::thread(Consumer, queues[i]));
+    threads.push_back(std::thread(Producer, queues[i], i));
+  }
+  for (auto& t : threads) {
+    t.join();
+  }
+  const uint64_t duration = benchmark::NowUs() - start;
+
+  const double ops = 2.0 * num_pairs * num_objects;
+  printf("prod_cons: pairs: %d, objects: %d, queue: %d, size: %lu-%lu\n",
+         num_pairs, num_objects, queue_size, min_size, max_size);
+  benchmark::Report("prod_cons", ops, duration);
+
+  for (auto q : queues) {
+    delete q;
+  }
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,108 @@
+// Copyright (c) 2015, the scalloc project authors.  All rights reserved.
+// Please see the AUTHORS file for details.  Use of this source code is governed
+// by a BSD license that can be found in the LICENSE file.
+
+// shbench (after MicroQuill's SmartHeap benchmark): Each thread allocates
+// objects of random sizes, biased towards small ones, in chunks and frees them
+// again with mixed lifetimes: part of a chunk is freed right away, part is
+// kept alive until a later chunk, so objects of different sizes and ages
+// interleave in memory. All frees are local.
+//
+// Usage: shbench [threads] [iterations] [chunk] [min size] [max size]
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <thread>
+#include <vector>
+
+#include "benchmark.h"
+
+namespace {
+
+int num_threads = 4;
+int iterations = 5000;
+int chunk_size = 1000;
+size_t min_size = 1;
+size_t max_size = 1000;
+
+benchmark::StartBarrier* barrier;
+
+
+// Sizes below max_size / 8 are picked about 8 times as often as others.
+size_t RandomSize(benchmark::Random* rand) {
+  const size_t small_max = min_size + (max_size - min_size) / 8;
+  if ((rand->Next() % 2) == 0) {
+    return rand->Range(min_size, small_max);
+  }
+  return rand->Range(min_size, max_size);
+}
+
+
+void Worker(int id) {
+  benchmark::Random rand(id);
+  void** current = static_cast<void**>(calloc(chunk_size, sizeof(void*)));
+  void** kept = static_cast<void**>(calloc(chunk_size, sizeof(void*)));
+  barrier->Wait();
+  for (int i = 0; i < iterations; i++) {
+    for (int j = 0; j < chunk_size; j++) {
+      const size_t size = RandomSize(&rand);
+      current[j] = malloc(size);
+      memset(current[j], j, size < 16 ? size : 16);
+    }
+    // Free every other object now, and the rest of the previous chunk.
+    for (int j = 0; j < chunk_size; j += 2) {
+      free(current[j]);
+      current[j] = nullptr;
+    }
+    for (int j = 0; j < chunk_size; j++) {
+      free(kept[j]);
+    }
+    void** tmp = kept;
+    kept = current;
+    current = tmp;
+  }
+  for (int j = 0; j < chunk_size; j++) {
+    free(kept[j]);
+  }
+  free(current);
+  free(kept);
+}
+
+}  // namespace
+
+
+int main(int argc, char** argv) {
+  if (argc > 1) { num_threads = atoi(argv[1]); }
+  if (argc > 2) { iterations = atoi(argv[2]); }
+  if (argc > 3) { chunk_size = atoi(argv[3]); }
+  if (argc > 4) { min_size = atol(argv[4]); }
+  if (argc > 5) { max_size = atol(argv[5]); }
+  if ((num_threads < 1) || (iterations < 1) || (chunk_size < 1) ||
+      (min_size < 1) || (max_size < min_size)) {
+    fprintf(stderr, "usage: %s [threads] [iterations] [chunk] [min size] "
+            "[max size]\n", argv[0]);
+    return EXIT_FAILURE;
+  }
+
+  barrier = new benchmark::StartBarrier(num_threads);
+  const uint64_t start = benchmark::NowUs();
+  std::vector<std::thread> threads;
+  for (int i = 0; i < num_threads; i++) {
+    threads.push_back(std::thread(Worker, i));
+  }
+  for (auto& t : threads) {
+    t.join();
+  }
+  const uint64_t duration = benchmark::NowUs() - start;
+
+  const double ops = 2.0 * num_threads * iterations * chunk_size;
+  printf("shbench: threads: %d, iterations: %d, chunk: %d, size: %lu-%lu\n",
+         num_threads, iterations, chunk_size, min_size, max_size);
+  benchmark::Report("shbench", ops, duration);
+
+  delete barrier;
+  return EXIT_SUCCESS;
+}
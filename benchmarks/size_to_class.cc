@@ -0,0 +1,90 @@
+// Copyright (c) 2015, the scalloc project authors.  All rights reserved.
+// Please see the AUTHORS file for details.  Use of this source code is governed
+// by a BSD license that can be found in the LICENSE file.
+
+// size-to-class: Measures scalloc's size class mapping, which runs on every
+// allocation, for small, medium, and mixed request sizes. Checks the mapping
+// against a linear search over all class sizes first.
+//
+// Build with the same size class geometry as the allocator (-Dsize_classes).
+//
+// Usage: size_to_class [iterations]
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <vector>
+
+#include "benchmark.h"
+#include "size_classes.h"
+
+namespace {
+
+const int kSizes = 1 << 16;
+
+int iterations = 1000;
+
+
+bool Check() {
+  for (size_t size = 0; size <= kMaxMediumSize; size++) {
+    const int32_t sc = scalloc::SizeToClass(size);
+    if (sc != scalloc::SmallestClassFitting(size)) {
+      fprintf(stderr,
+              "size_to_class: size %lu maps to class %d instead of %d\n",
+              size, sc, scalloc::SmallestClassFitting(size));
+      return false;
+    }
+  }
+  return true;
+}
+
+
+void Run(const char* name, const std::vector<size_t>& sizes) {
+  uint64_t sum = 0;
+  const uint64_t start = benchmark::NowUs();
+  for (int i = 0; i < iterations; i++) {
+    for (size_t size : sizes) {
+      sum += scalloc::SizeToClass(size);
+    }
+  }
+  const uint64_t duration = benchmark::NowUs() - start;
+  const double ops = static_cast<double>(iterations) * sizes.size();
+  // Printing the sum keeps the compiler from dropping the loop.
+  printf("%s: checksum: %lu, %.2f ns/op\n", name, sum, duration * 1e3 / ops);
+  benchmark::Report(name, ops, duration);
+}
+
+}  // namespace
+
+
+int main(int argc, char** argv) {
+  if (argc > 1) { iterations = atoi(argv[1]); }
+  if (iterations < 1) {
+    fprintf(stderr, "usage: %s [iterations]\n", argv[0]);
+    return EXIT_FAILURE;
+  }
+  if (!Check()) {
+    return EXIT_FAILURE;
+  }
+
+  benchmark::Random random(1);
+  std::vector<size_t> small;
+  std::vector<size_t> medium;
+  std::vector<size_t> mixed;
+  for (int i = 0; i < kSizes; i++) {
+    small.push_back(random.Range(1, kMaxSmallSize));
+    // Uniform over powers of two, as medium requests get rarer with size.
+    const uint64_t shift = random.Range(kMaxSmallShift, kMaxMediumShift - 1);
+    medium.push_back(random.Range((1UL << shift) + 1, 2UL << shift));
+    mixed.push_back((random.Range(0, 9) == 0) ? medium.back() :
+                                                random.Range(1, 1024));
+  }
+
+  printf("size_to_class: classes: %d, sizes: %d, iterations: %d\n",
+         kNumClasses, kSizes, iterations);
+  Run("size_to_class_small", small);
+  Run("size_to_class_medium", medium);
+  Run("size_to_class_mixed", mixed);
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,112 @@
+// Copyright (c) 2015, the scalloc project authors.  All rights reserved.
+// Please see the AUTHORS file for details.  Use of this source code is governed
+// by a BSD license that can be found in the LICENSE file.
+
+// span-pool-steal: Generations of short-lived threads allocate and free medium
+// objects, i.e., whole spans. Spans are returned to the span pool backend of
+// the thread that owned them. Only every other thread of a generation
+// allocates, alternating between generations, so that threads mostly find
+// their own backend empty and have to take spans from the backends of threads
+// of the previous generation. The first generation finds the pool empty
+// altogether. Run it with many threads to stress span pool stealing.
+//
+// Usage: span_pool_steal [threads] [generations] [objects] [object size]
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "benchmark.h"
+
+namespace {
+
+int num_threads = 64;
+int generations = 100;
+int num_objects = 256;
+size_t object_size = 65536;
+
+
+// Keeps all threads of a generation alive at the same time, as the span pool
+// only uses as many backends as there are threads. Blocks instead of spinning,
+// since there are usually more threads than CPUs.
+class Generation {
+ public:
+  explicit Generation(int threads) : waiting_(threads) {}
+
+  void Wait() {
+    std::unique_lock<std::mutex> lock(mutex_);
+    if (--waiting_ == 0) {
+      all_started_.notify_all();
+    }
+    all_started_.wait(lock, [this] { return waiting_ == 0; });
+  }
+
+ private:
+  int waiting_;
+  std::mutex mutex_;
+  std::condition_variable all_started_;
+};
+
+
+void Worker(Generation* generation, bool allocating) {
+  generation->Wait();
+  if (!allocating) {
+    return;
+  }
+  std::vector<void*> objects(num_objects);
+  for (int i = 0; i < num_objects; i++) {
+    objects[i] = malloc(object_size);
+    // Touch the object, as spans come with their memory.
+    static_cast<volatile char*>(objects[i])[0] = static_cast<char>(i);
+  }
+  for (int i = 0; i < num_objects; i++) {
+    free(objects[i]);
+  }
+}
+
+}  // namespace
+
+
+int main(int argc, char** argv) {
+  if (argc > 1) { num_threads = atoi(argv[1]); }
+  if (argc > 2) { generations = atoi(argv[2]); }
+  if (argc > 3) { num_objects = atoi(argv[3]); }
+  if (argc > 4) { object_size = atol(argv[4]); }
+  if ((num_threads < 1) || (generations < 1) || (num_objects < 1) ||
+      (object_size < 1)) {
+    fprintf(stderr,
+            "usage: %s [threads] [generations] [objects] [object size]\n",
+            argv[0]);
+    return EXIT_FAILURE;
+  }
+
+  // Includes starting and joining threads, which does not depend on the
+  // allocator much.
+  uint64_t allocating_threads = 0;
+  const uint64_t start = benchmark::NowUs();
+  for (int g = 0; g < generations; g++) {
+    Generation generation(num_threads);
+    std::vector<std::thread> threads;
+    for (int i = 0; i < num_threads; i++) {
+      const bool allocating = ((i + g) % 2) == 0;
+      allocating_threads += allocating ? 1 : 0;
+      threads.push_back(std::thread(Worker, &generation, allocating));
+    }
+    for (auto& t : threads) {
+      t.join();
+    }
+  }
+  const uint64_t duration = benchmark::NowUs() - start;
+
+  const double ops = 2.0 * allocating_threads * num_objects;
+  printf("span_pool_steal: threads: %d, generations: %d, objects: %d, "
+         "size: %lu\n", num_threads, generations, num_objects, object_size);
+  benchmark::Report("span_pool_steal", ops, duration);
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,116 @@
+// Copyright (c) 2015, the scalloc project authors.  All rights reserved.
+// Please see the AUTHORS file for details.  Use of this source code is governed
+// by a BSD license that can be found in the LICENSE file.
+
+// Stresses the sets of reusable spans. Threads are arranged in a ring: Each
+// thread allocates a batch of objects, hands it to its successor, and frees the
+// batch handed in by its predecessor. Almost all frees are thus remote frees
+// that move spans into the reusable set of their owner, while the owner keeps
+// taking spans out of the same set.
+//
+// Usage: span_reuse [threads] [rounds] [batch] [object size]
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <atomic>
+#include <thread>
+#include <vector>
+
+#include "benchmark.h"
+
+namespace {
+
+struct Mailbox {
+  std::atomic<void**> batch;
+  char pad[64 - sizeof(std::atomic<void**>)];
+};
+
+int num_threads = 64;
+int rounds = 2000;
+int batch_size = 1024;
+size_t object_size = 64;
+
+Mailbox* mailboxes;
+std::atomic<int> ready;
+
+
+void** AllocateBatch() {
+  void** batch = static_cast<void**>(malloc(batch_size * sizeof(void*)));
+  for (int i = 0; i < batch_size; i++) {
+    batch[i] = malloc(object_size);
+    memset(batch[i], i, object_size);
+  }
+  return batch;
+}
+
+
+void FreeBatch(void** batch) {
+  for (int i = 0; i < batch_size; i++) {
+    free(batch[i]);
+  }
+  free(batch);
+}
+
+
+void Worker(int id) {
+  Mailbox* out = &mailboxes[(id + 1) % num_threads];
+  Mailbox* in = &mailboxes[id];
+
+  ready.fetch_add(1);
+  while (ready.load() != num_threads) {}
+
+  for (int r = 0; r < rounds; r++) {
+    void** batch = AllocateBatch();
+    void** expected = nullptr;
+    while (!out->batch.compare_exchange_weak(expected, batch)) {
+      expected = nullptr;
+      std::this_thread::yield();
+    }
+    void** received;
+    while ((received = in->batch.exchange(nullptr)) == nullptr) {
+      std::this_thread::yield();
+    }
+    FreeBatch(received);
+  }
+}
+
+}  // namespace
+
+
+int main(int argc, char** argv) {
+  if (argc > 1) { num_threads = atoi(argv[1]); }
+  if (argc > 2) { rounds = atoi(argv[2]); }
+  if (argc > 3) { batch_size = atoi(argv[3]); }
+  if (argc > 4) { object_size = atol(argv[4]); }
+  if ((num_threads < 2) || (rounds < 1) || (batch_size < 1)) {
+    fprintf(stderr, "usage: %s [threads] [rounds] [batch] [object size]\n",
+            argv[0]);
+    return EXIT_FAILURE;
+  }
+
+  mailboxes = new Mailbox[num_threads];
+  for (int i = 0; i < num_threads; i++) {
+    mailboxes[i].batch.store(nullptr);
+  }
+
+  const uint64_t start = benchmark::NowUs();
+  std::vector<std::thread> threads;
+  for (int i = 0; i < num_threads; i++) {
+    threads.push_back(std::thread(Worker, i));
+  }
+  for (auto& t : threads) {
+    t.join();
+  }
+  const uint64_t duration = benchmark::NowUs() - start;
+
+  const double ops = 2.0 * num_threads * rounds * batch_size;
+  printf("span_reuse: threads: %d, rounds: %d, batch: %d, size: %lu\n",
+         num_threads, rounds, batch_size, object_size);
+  benchmark::Report("span_reuse", ops, duration);
+
+  delete[] mailboxes;
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,83 @@
+// Copyright (c) 2015, the scalloc project authors.  All rights reserved.
+// Please see the AUTHORS file for details.  Use of this source code is governed
+// by a BSD license that can be found in the LICENSE file.
+
+// threadtest (from the Hoard benchmarks): Each thread repeatedly allocates a
+// batch of objects and frees them again in allocation order. A fixed amount of
+// work is split among the threads, so an allocator that scales keeps the time
+// constant with increasing thread counts. All frees are local.
+//
+// Usage: threadtest [threads] [iterations] [objects] [object size]
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <thread>
+#include <vector>
+
+#include "benchmark.h"
+
+namespace {
+
+int num_threads = 4;
+int iterations = 1000;
+int num_objects = 100000;
+size_t object_size = 8;
+
+benchmark::StartBarrier* barrier;
+
+
+void Worker() {
+  const int objects = num_objects / num_threads;
+  void** objs = static_cast<void**>(malloc(objects * sizeof(void*)));
+  barrier->Wait();
+  for (int i = 0; i < iterations; i++) {
+    for (int j = 0; j < objects; j++) {
+      objs[j] = malloc(object_size);
+      // Touch the object so that the allocation cannot be optimized away.
+      *static_cast<volatile char*>(objs[j]) = static_cast<char>(j);
+    }
+    for (int j = 0; j < objects; j++) {
+      free(objs[j]);
+    }
+  }
+  free(objs);
+}
+
+}  // namespace
+
+
+int main(int argc, char** argv) {
+  if (argc > 1) { num_threads = atoi(argv[1]); }
+  if (argc > 2) { iterations = atoi(argv[2]); }
+  if (argc > 3) { num_objects = atoi(argv[3]); }
+  if (argc > 4) { object_size = atol(argv[4]); }
+  if ((num_threads < 1) || (iterations < 1) || (num_objects < num_threads) ||
+      (object_size < 1)) {
+    fprintf(stderr, "usage: %s [threads] [iterations] [objects] [object size]\n",
+            argv[0]);
+    return EXIT_FAILURE;
+  }
+
+  barrier = new benchmark::StartBarrier(num_threads);
+  const uint64_t start = benchmark::NowUs();
+  std::vector<std::thread> threads;
+  for (int i = 0; i < num_threads; i++) {
+    threads.push_back(std::thread(Worker));
+  }
+  for (auto& t : threads) {
+    t.join();
+  }
+  const uint64_t duration = benchmark::NowUs() - start;
+
+  const double ops =
+      2.0 * iterations * (num_objects / num_threads) * num_threads;
+  printf("threadtest: threads: %d, iterations: %d, objects: %d, size: %lu\n",
+         num_threads, iterations, num_objects, object_size);
+  benchmark::Report("threadtest", ops, duration);
+
+  delete barrier;
+  return EXIT_SUCCESS;
+}
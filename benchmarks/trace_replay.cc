@@ -0,0 +1,273 @@
+// Copyright (c) 2015, the scalloc project authors.  All rights reserved.
+// Please see the AUTHORS file for details.  Use of this source code is governed
+// by a BSD license that can be found in the LICENSE file.
+
+// Replays an allocation trace recorded by scalloc (built with -Dtrace=yes and
+// run with SCALLOC_TRACE=<prefix>) against the allocator this program runs
+// with, i.e., the system allocator or any preloaded one.
+//
+// Every traced thread is replayed by its own thread, performing the thread's
+// operations in their original order. Objects are matched up by address and
+// time, and an operation on an object waits until the object has been
+// allocated by whichever thread allocated it in the trace. With -s, all
+// operations are serialized in their original global order instead, which is
+// deterministic but slow. Allocated objects are touched once per page.
+//
+// Reports time, throughput, and the peak RSS sampled during the replay.
+//
+// Usage: trace_replay [-s] <trace file>
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <deque>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+#include "benchmark.h"
+#include "scalloc.h"
+
+namespace {
+
+const uint32_t kNoObject = UINT32_MAX;
+const size_t kPageSize = 4096;
+
+struct Op {
+  uint64_t seq;
+  uint64_t size;
+  uint32_t object;
+  uint32_t old_object;
+  uint16_t op;
+  uint16_t alignment_shift;
+};
+
+bool strict = false;
+std::vector<std::vector<Op>> thread_ops;
+std::atomic<void*>* objects;
+std::atomic<uint64_t> turn;
+std::atomic<bool> done;
+std::atomic<uint64_t> peak_rss_kb;
+
+
+bool ReadTrace(const char* path, std::vector<scalloc_trace_record>* records) {
+  FILE* f = fopen(path, "rb");
+  if (f == nullptr) {
+    perror(path);
+    return false;
+  }
+  scalloc_trace_header header;
+  if ((fread(&header, sizeof(header), 1, f) != 1) ||
+      (header.magic != SCALLOC_TRACE_MAGIC) ||
+      (header.version != SCALLOC_TRACE_VERSION) ||
+      (header.record_size != sizeof(scalloc_trace_record))) {
+    fprintf(stderr, "%s: not a trace of version %d\n", path,
+            SCALLOC_TRACE_VERSION);
+    fclose(f);
+    return false;
+  }
+  scalloc_trace_record buf[4096];
+  size_t n;
+  while ((n = fread(buf, sizeof(buf[0]), 4096, f)) > 0) {
+    records->insert(records->end(), buf, buf + n);
+  }
+  fclose(f);
+  return true;
+}
+
+
+// Turns addresses into object ids and splits the trace into per-thread
+// operations. Returns the number of objects.
+uint32_t Prepare(std::vector<scalloc_trace_record>* records,
+                 uint64_t* unmatched) {
+  std::stable_sort(records->begin(), records->end(),
+                   [](const scalloc_trace_record& a,
+                      const scalloc_trace_record& b) {
+                     return a.timestamp < b.timestamp;
+                   });
+  // An address may be allocated again before the free of its previous object
+  // shows up (see scalloc.h), so frees release the oldest object at an
+  // address.
+  std::unordered_map<uint64_t, std::deque<uint32_t>> live;
+  std::unordered_map<uint32_t, uint32_t> threads;
+  uint32_t next_object = 0;
+  uint64_t seq = 0;
+  *unmatched = 0;
+  for (const scalloc_trace_record& r : *records) {
+    Op op;
+    op.size = r.size;
+    op.object = kNoObject;
+    op.old_object = kNoObject;
+    op.op = r.op;
+    op.alignment_shift = r.alignment_shift;
+    if ((r.op == SCALLOC_TRACE_FREE) || (r.op == SCALLOC_TRACE_REALLOC)) {
+      const uint64_t address =
+          (r.op == SCALLOC_TRACE_FREE) ? r.object : r.old_object;
+      auto it = live.find(address);
+      if (it != live.end()) {
+        op.old_object = it->second.front();
+        it->second.pop_front();
+        if (it->second.empty()) {
+          live.erase(it);
+        }
+      } else if (address != 0) {
+        (*unmatched)++;
+      }
+      if ((r.op == SCALLOC_TRACE_FREE) && (op.old_object == kNoObject)) {
+        continue;
+      }
+    }
+    if (r.op != SCALLOC_TRACE_FREE) {
+      op.object = next_object++;
+      live[r.object].push_back(op.object);
+    }
+    auto t = threads.find(r.thread);
+    if (t == threads.end()) {
+      t = threads.insert(std::make_pair(r.thread, thread_ops.size())).first;
+      thread_ops.push_back(std::vector<Op>());
+    }
+    op.seq = seq++;
+    thread_ops[t->second].push_back(op);
+  }
+  return next_object;
+}
+
+
+void* Touch(void* p, uint64_t size) {
+  if (p != nullptr) {
+    for (uint64_t i = 0; i < size; i += kPageSize) {
+      static_cast<volatile char*>(p)[i] = 1;
+    }
+  }
+  return p;
+}
+
+
+void* Await(uint32_t object) {
+  void* p;
+  while ((p = objects[object].load(std::memory_order_acquire)) == nullptr) {
+    std::this_thread::yield();
+  }
+  return p;
+}
+
+
+void Replay(const std::vector<Op>* ops) {
+  for (const Op& op : *ops) {
+    if (strict) {
+      while (turn.load(std::memory_order_acquire) != op.seq) {
+        std::this_thread::yield();
+      }
+    }
+    void* p = nullptr;
+    switch (op.op) {
+      case SCALLOC_TRACE_MALLOC:
+        p = malloc(op.size);
+        break;
+      case SCALLOC_TRACE_CALLOC:
+        p = calloc(1, op.size);
+        break;
+      case SCALLOC_TRACE_MEMALIGN: {
+        size_t alignment = static_cast<size_t>(1) << op.alignment_shift;
+        if (alignment < sizeof(void*)) {
+          alignment = sizeof(void*);
+        }
+        if (posix_memalign(&p, alignment, op.size) != 0) {
+          p = nullptr;
+        }
+        break;
+      }
+      case SCALLOC_TRACE_REALLOC: {
+        void* old = (op.old_object != kNoObject) ? Await(op.old_object) :
+                                                   nullptr;
+        p = realloc(old, op.size);
+        break;
+      }
+      case SCALLOC_TRACE_FREE:
+        free(Await(op.old_object));
+        break;
+    }
+    if (op.object != kNoObject) {
+      if (p == nullptr) {
+        fprintf(stderr, "trace_replay: out of memory\n");
+        exit(EXIT_FAILURE);
+      }
+      objects[op.object].store(Touch(p, op.size), std::memory_order_release);
+    }
+    if (strict) {
+      turn.store(op.seq + 1, std::memory_order_release);
+    }
+  }
+}
+
+
+void MonitorRss() {
+  while (!done.load()) {
+    const uint64_t rss = benchmark::RssKb();
+    if (rss > peak_rss_kb.load()) {
+      peak_rss_kb.store(rss);
+    }
+    std::this_thread::sleep_for(std::chrono::milliseconds(10));
+  }
+}
+
+}  // namespace
+
+
+int main(int argc, char** argv) {
+  int arg = 1;
+  if ((arg < argc) && (strcmp(argv[arg], "-s") == 0)) {
+    strict = true;
+    arg++;
+  }
+  if (arg != (argc - 1)) {
+    fprintf(stderr, "usage: %s [-s] <trace file>\n", argv[0]);
+    return EXIT_FAILURE;
+  }
+
+  std::vector<scalloc_trace_record> records;
+  if (!ReadTrace(argv[arg], &records)) {
+    return EXIT_FAILURE;
+  }
+  uint64_t unmatched;
+  const uint32_t num_objects = Prepare(&records, &unmatched);
+  const uint64_t num_records = records.size();
+  std::vector<scalloc_trace_record>().swap(records);
+  objects = new std::atomic<void*>[num_objects + 1];
+  for (uint32_t i = 0; i < num_objects; i++) {
+    objects[i].store(nullptr);
+  }
+  uint64_t num_ops = 0;
+  for (auto& ops : thread_ops) {
+    num_ops += ops.size();
+  }
+
+  const uint64_t rss_before = benchmark::RssKb();
+  peak_rss_kb.store(rss_before);
+  done.store(false);
+  std::thread monitor(MonitorRss);
+  const uint64_t start = benchmark::NowUs();
+  std::vector<std::thread> threads;
+  for (auto& ops : thread_ops) {
+    threads.push_back(std::thread(Replay, &ops));
+  }
+  for (auto& t : threads) {
+    t.join();
+  }
+  const uint64_t duration = benchmark::NowUs() - start;
+  done.store(true);
+  monitor.join();
+
+  printf("trace_replay: records: %lu, operations: %lu, threads: %lu, "
+         "objects: %u, unmatched frees: %lu, %s\n",
+         num_records, num_ops, thread_ops.size(), num_objects, unmatched,
+         strict ? "strict" : "relaxed");
+  printf("trace_replay: rss before replay: %lu KiB\n", rss_before);
+  benchmark::Report("trace_replay", num_ops, duration, peak_rss_kb.load());
+  return EXIT_SUCCESS;
+}
@@ -13,6 +13,13 @@
     'safe_global_construction%': 'no',
     'strict_memory%': 'no',
     'disable_transparent_hugepages%': 'no' ,
+    'huge_pages%': 'no',
+    'heap_profiler%': 'yes',
+    'trace%': 'no',
+    'size_classes%': 'huge',
+    'large_object_cache_size%': 'default',
+    'scavenger_decay%': 'default',
+    'numa%': 'no',
   },
   'conditions': [
   ],
@@ -35,6 +42,11 @@
             'src/platform/pthread_intercept.cc'
           ]
         }],
+        ['OS=="linux" and "yes"=="<(numa)"', {
+          'defines': [
+            'SCALLOC_NUMA'
+          ]
+        }],
         ['"no"=="<(madvise)"', {
           'defines': [
             'SCALLOC_NO_MADVISE'
@@ -60,6 +72,16 @@
             'SCALLOC_NO_SAFE_GLOBAL_CONSTRUCTION'
           ]
         }],
+        ['"default"!="<(large_object_cache_size)"', {
+          'defines': [
+            'SCALLOC_LARGE_OBJECT_CACHE_SIZE=<(large_object_cache_size)'
+          ]
+        }],
+        ['"default"!="<(scavenger_decay)"', {
+          'defines': [
+            'SCALLOC_SCAVENGER_DECAY=<(scavenger_decay)'
+          ]
+        }],
         ['"yes"=="<(strict_memory)"', {
           'defines': [
             'SCALLOC_STRICT_DUMP',
@@ -71,6 +93,26 @@
             'SCALLOC_DISABLE_TRANSPARENT_HUGEPAGES',
           ]
         }],
+        ['"no"=="<(heap_profiler)"', {
+          'defines': [
+            'SCALLOC_NO_HEAP_PROFILER',
+          ]
+        }],
+        ['"yes"=="<(trace)"', {
+          'defines': [
+            'SCALLOC_TRACE',
+          ]
+        }],
+        ['"yes"=="<(huge_pages)"', {
+          'defines': [
+            'SCALLOC_HUGE_PAGES',
+          ]
+        }],
+        ['"dense"=="<(size_classes)"', {
+          'defines': [
+            'SCALLOC_SIZE_CLASSES_DENSE',
+          ]
+        }],
       ],
       'sources': [
         'src/arena.h',
@@ -80,21 +122,183 @@
         'src/log.h',
         'src/glue.h',
         'src/glue.cc',
+        'src/heap_profiler.h',
+        'src/large_object_cache.h',
+        'src/large-objects.h',
+        'src/orphan_spans.h',
         'src/platform/assert.h',
         'src/platform/globals.h',
+        'src/platform/numa.h',
         'src/platform/override.h',
         'src/platform/override_gcc_weak.h',
         'src/platform/override_osx.h',
+        'src/platform/rseq.h',
         'src/platform/pthread_intercept.h',
         'src/platform/pthread_intercept.cc',
+        'src/reusable_spans.h',
+        'src/scalloc.h',
+        'src/scavenger.h',
         'src/size_classes.h',
         'src/span.h',
         'src/span_pool.h',
+        'src/stats.h',
+        'src/trace.h',
         'src/utils.h'
       ],
       'include_dirs': [
         'src',
       ]
     },
+    {
+      'target_name': 'span_reuse',
+      'product_name': 'span_reuse',
+      'type': 'executable',
+      'ldflags': [ '-pthread' ],
+      'sources': [
+        'benchmarks/benchmark.h',
+        'benchmarks/span_reuse.cc',
+      ],
+    },
+    {
+      'target_name': 'numa_locality',
+      'product_name': 'numa_locality',
+      'type': 'executable',
+      'ldflags': [ '-pthread' ],
+      'sources': [
+        'benchmarks/benchmark.h',
+        'benchmarks/numa_locality.cc',
+      ],
+    },
+    {
+      'target_name': 'threadtest',
+      'product_name': 'threadtest',
+      'type': 'executable',
+      'ldflags': [ '-pthread' ],
+      'sources': [
+        'benchmarks/benchmark.h',
+        'benchmarks/threadtest.cc',
+      ],
+    },
+    {
+      'target_name': 'larson',
+      'product_name': 'larson',
+      'type': 'executable',
+      'ldflags': [ '-pthread' ],
+      'sources': [
+        'benchmarks/benchmark.h',
+        'benchmarks/larson.cc',
+      ],
+    },
+    {
+      'target_name': 'shbench',
+      'product_name': 'shbench',
+      'type': 'executable',
+      'ldflags': [ '-pthread' ],
+      'sources': [
+        'benchmarks/benchmark.h',
+        'benchmarks/shbench.cc',
+      ],
+    },
+    {
+      'target_name': 'cache_thrash',
+      'product_name': 'cache_thrash',
+      'type': 'executable',
+      'ldflags': [ '-pthread' ],
+      'sources': [
+        'benchmarks/benchmark.h',
+        'benchmarks/cache_thrash.cc',
+      ],
+    },
+    {
+      'target_name': 'cache_scratch',
+      'product_name': 'cache_scratch',
+      'type': 'executable',
+      'ldflags': [ '-pthread' ],
+      'sources': [
+        'benchmarks/benchmark.h',
+        'benchmarks/cache_scratch.cc',
+      ],
+    },
+    {
+      'target_name': 'prod_cons',
+      'product_name': 'prod_cons',
+      'type': 'executable',
+      'ldflags': [ '-pthread' ],
+      'sources': [
+        'benchmarks/benchmark.h',
+        'benchmarks/prod_cons.cc',
+      ],
+    },
+    {
+      'target_name': 'linux_scalability',
+      'product_name': 'linux_scalability',
+      'type': 'executable',
+      'ldflags': [ '-pthread' ],
+      'sources': [
+        'benchmarks/benchmark.h',
+        'benchmarks/linux_scalability.cc',
+      ],
+    },
+    {
+      'target_name': 'span_pool_steal',
+      'product_name': 'span_pool_steal',
+      'type': 'executable',
+      'ldflags': [ '-pthread' ],
+      'sources': [
+        'benchmarks/benchmark.h',
+        'benchmarks/span_pool_steal.cc',
+      ],
+    },
+    {
+      'target_name': 'trace_replay',
+      'product_name': 'trace_replay',
+      'type': 'executable',
+      'ldflags': [ '-pthread' ],
+      'sources': [
+        'benchmarks/benchmark.h',
+        'benchmarks/trace_replay.cc',
+      ],
+      'include_dirs': [
+        'src',
+      ],
+    },
+    {
+      'target_name': 'size_to_class',
+      'product_name': 'size_to_class',
+      'type': 'executable',
+      'sources': [
+        'benchmarks/benchmark.h',
+        'benchmarks/size_to_class.cc',
+      ],
+      'include_dirs': [
+        'src',
+      ],
+      'conditions': [
+        ['"dense"=="<(size_classes)"', {
+          'defines': [
+            'SCALLOC_SIZE_CLASSES_DENSE',
+          ]
+        }],
+      ],
+    },
+    {
+      # Builds all allocator benchmarks, see tools/run_benchmarks.sh.
+      'target_name': 'benchmarks',
+      'type': 'none',
+      'dependencies': [
+        'threadtest',
+        'larson',
+        'shbench',
+        'cache_thrash',
+        'cache_scratch',
+        'prod_cons',
+        'linux_scalability',
+        'span_pool_steal',
+        'span_reuse',
+        'numa_locality',
+        'trace_replay',
+        'size_to_class',
+      ],
+    },
   ],
 }
@@ -9,7 +9,11 @@
 #include <cstdint>
 
 #include "globals.h"
+#include "lock.h"
 #include "platform/assert.h"
+#ifdef SCALLOC_NUMA
+#include "platform/numa.h"
+#endif  // SCALLOC_NUMA
 #include "utils.h"
 
 namespace scalloc {
@@ -25,6 +29,15 @@ class Arena {
   always_inline void* Allocate(size_t size);
   always_inline void* AllocateVirtualSpan();
 
+#ifdef SCALLOC_NUMA
+  // Splits the arena into equally sized partitions, one per NUMA node, with
+  // memory of each partition preferably placed on its node.
+  always_inline void Partition(int32_t nodes);
+  always_inline void* AllocateVirtualSpan(int32_t node);
+  always_inline int32_t NodeOf(const void* p);
+  always_inline int32_t nodes() { return nodes_; }
+#endif  // SCALLOC_NUMA
+
  private:
   const char* name_;
 
@@ -43,6 +56,50 @@ class Arena {
   std::atomic<uintptr_t> current_;
   UNUSED uint8_t pad2_[64  -
       ((sizeof(current_)) % 64)];
+
+#ifdef SCALLOC_NUMA
+  struct NodePartition {
+    uintptr_t end;
+    std::atomic<uintptr_t> current;
+    UNUSED uint8_t pad[64 - ((sizeof(end) + sizeof(current)) % 64)];
+  };
+
+  int32_t nodes_;
+  uintptr_t partition_size_;
+  UNUSED uint8_t pad3_[64 - ((sizeof(nodes_) + sizeof(partition_size_)) % 64)];
+
+  NodePartition partitions_[kMaxNumaNodes];
+#endif  // SCALLOC_NUMA
+};
+
+
+// An arena that grows in chunks that are mapped on demand, used for memory
+// that is allocated rarely and never returned, e.g., cores. Physical memory is
+// only committed once touched.
+class ChunkedArena {
+ public:
+  // Globally constructed, hence we use staged construction.
+  always_inline ChunkedArena() {}
+  always_inline ~ChunkedArena() {}
+
+  always_inline void Init(size_t chunk_size, const char* name);
+  always_inline void* Allocate(size_t size);
+
+ private:
+  typedef SpinLock<64> Lock;
+
+  const char* name_;
+  size_t chunk_size_;
+  uintptr_t current_;
+  uintptr_t end_;
+
+  UNUSED uint8_t pad_[64 -
+      ((sizeof(name_) +
+        sizeof(chunk_size_) +
+        sizeof(current_) +
+        sizeof(end_)) % 64)];
+
+  Lock lock_;
 };
 
 
@@ -70,6 +127,16 @@ void Arena::Init(size_t size, size_t alignment, const char* name) {
   madvise(reinterpret_cast<void*>(start_), len_, MADV_DONTDUMP);
 #endif  // DEBUG && MADV_DONTDUMP
 
+#if defined(SCALLOC_HUGE_PAGES) && defined(MADV_HUGEPAGE)
+  if (madvise(reinterpret_cast<void*>(start_), len_, MADV_HUGEPAGE) != 0) {
+    LOG(kWarning, "%s arena: madvise MADV_HUGEPAGE failed", name_);
+  }
+#endif  // SCALLOC_HUGE_PAGES && MADV_HUGEPAGE
+
+#ifdef SCALLOC_NUMA
+  Partition(1);
+#endif  // SCALLOC_NUMA
+
   LOG(kTrace, "arena at %p", this);
 }
 
@@ -98,6 +165,9 @@ void* Arena::Allocate(size_t size) {
 
 
 void* Arena::AllocateVirtualSpan() {
+#ifdef SCALLOC_NUMA
+  return AllocateVirtualSpan(0);
+#else
   LOG(kTrace, "allocate: %lu", kVirtualSpanSize);
   uintptr_t obj = current_.fetch_add(kVirtualSpanSize);
   if (UNLIKELY((obj + kVirtualSpanSize) >= end_)) {
@@ -109,7 +179,80 @@ void* Arena::AllocateVirtualSpan() {
   madvise(reinterpret_cast<void*>(obj), kVirtualSpanSize, MADV_DODUMP);
 #endif  // DEBUG && MADV_DODUMP
   return reinterpret_cast<void*>(obj);
+#endif  // SCALLOC_NUMA
+}
+
+
+void ChunkedArena::Init(size_t chunk_size, const char* name) {
+  ScallocAssert((chunk_size % kPageSize) == 0);
+  name_ = name;
+  chunk_size_ = chunk_size;
+  current_ = 0;
+  end_ = 0;
+}
+
+
+// Returns cache-line aligned memory, or nullptr if the system is out of
+// memory.
+void* ChunkedArena::Allocate(size_t size) {
+  size = PadSize(size, kCacheLineSize);
+  Lock::Guard guard(lock_);
+  if (UNLIKELY((current_ + size) > end_)) {
+    // The rest of the current chunk is wasted.
+    const size_t chunk_size =
+        (size > chunk_size_) ? PadSize(size, kPageSize) : chunk_size_;
+    void* chunk = SystemMmap(chunk_size);
+    if (UNLIKELY(chunk == nullptr)) {
+      LOG(kWarning, "%s arena: mapping a new chunk failed", name_);
+      return nullptr;
+    }
+    current_ = reinterpret_cast<uintptr_t>(chunk);
+    end_ = current_ + chunk_size;
+  }
+  const uintptr_t obj = current_;
+  current_ += size;
+  LOG(kTrace, "%s: obj: %p", name_, obj);
+  return reinterpret_cast<void*>(obj);
+}
+
+
+#ifdef SCALLOC_NUMA
+void Arena::Partition(int32_t nodes) {
+  ScallocAssert((nodes > 0) && (nodes <= kMaxNumaNodes));
+  ScallocAssert(current_.load() == start_);
+  nodes_ = nodes;
+  partition_size_ = (len_ / nodes) & kVirtualSpanMask;
+  for (int32_t i = 0; i < nodes; i++) {
+    const uintptr_t start = start_ + i * partition_size_;
+    partitions_[i].end = start + partition_size_;
+    partitions_[i].current.store(start);
+    if (nodes > 1) {
+      NumaPreferNode(reinterpret_cast<void*>(start), partition_size_, i);
+    }
+  }
+}
+
+
+void* Arena::AllocateVirtualSpan(int32_t node) {
+  ScallocAssert(node < nodes_);
+  uintptr_t obj = partitions_[node].current.fetch_add(kVirtualSpanSize);
+  if (UNLIKELY((obj + kVirtualSpanSize) >= partitions_[node].end)) {
+    Fatal("%s arena OOM on node %d; start: %p, end: %p, curr: %p",
+        name_, node, start_, end_, partitions_[node].current.load());
+  }
+  LOG(kTrace, "%s: obj: %p, node: %d", name_, obj, node);
+#if defined(SCALLOC_STRICT_DUMP) && defined(MADV_DODUMP)
+  madvise(reinterpret_cast<void*>(obj), kVirtualSpanSize, MADV_DODUMP);
+#endif  // DEBUG && MADV_DODUMP
+  return reinterpret_cast<void*>(obj);
+}
+
+
+int32_t Arena::NodeOf(const void* p) {
+  ScallocAssert(Contains(p));
+  return (reinterpret_cast<uintptr_t>(p) - start_) / partition_size_;
 }
+#endif  // SCALLOC_NUMA
 
 }  // namespace scalloc
 
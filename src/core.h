@@ -7,60 +7,167 @@
 
 #include <pthread.h>
 #include <stdlib.h>
+#include <string.h>
+
+#include <atomic>
 
 #include "arena.h"
 #include "atomic_value.h"
 #include "core_id.h"
-#include "deque.h"
 #include "globals.h"
+#include "heap_profiler.h"
 #include "large-objects.h"
 #include "lock.h"
+#include "orphan_spans.h"
+#include "reusable_spans.h"
 #include "size_classes.h"
 #include "span.h"
+#include "stats.h"
 
 namespace scalloc {
 
-extern int seen_memalign;
-
-
 class Core {
  public:
   always_inline Core();
   always_inline void* Allocate(size_t size);
+  always_inline void* AllocateZeroed(size_t size);
   always_inline void Free(void* p);
+  always_inline void Free(void* p, int32_t size_class);
   always_inline void Destroy();
   always_inline void Init(core_id id);
 
+  // Flushes the remote frees buffered by all other cores, on behalf of this
+  // core. Used by the scavenger, as a thread that goes idle would otherwise
+  // keep its buffered objects, and thus their spans, indefinitely.
+  always_inline void FlushRemoteFreesOfOtherCores();
+
+  // Makes cores guard their remote free buffers against
+  // FlushRemoteFreesOfOtherCores(). Cores only pay for the lock once this has
+  // been called, and pick it up the next time they flush all of their buffers.
+  static always_inline void ShareRemoteFrees() { share_remote_frees_ = true; }
+
  protected:
   typedef Stack<64> RemoteFullSpans;
+  typedef SpinLock<> RemoteFreesLock;
+
+  // Objects freed to a span owned by another core, linked up from head to
+  // tail.
+  struct RemoteFreeBatch {
+    Span* span;
+    void* head;
+    void* tail;
+    int32_t len;
+  };
 
   always_inline core_id id() { return id_; }
 
   always_inline void CheckAlignments();
   always_inline Span* GetSpan(int32_t sc);
+  always_inline void DeleteSpan(Span* s);
+  always_inline bool UnlinkSpan(Span* s);
+  always_inline ReusableSpans* GetReusableSpans(int32_t sc);
+  always_inline void Orphan(Span* s);
+  always_inline void* Allocate(size_t size, bool* zeroed);
+  always_inline void* AllocateObject(size_t size, bool* zeroed);
+#ifdef SCALLOC_HEAP_PROFILER
+  inline void* AllocateSampled(size_t size, bool* zeroed);
+#endif  // SCALLOC_HEAP_PROFILER
+  always_inline void* AllocateFromHotSpan(int32_t sc, bool* zeroed);
+  always_inline void CountAllocation(int32_t sc, size_t size);
+  always_inline void FlushObjectCache(int32_t sc);
+  always_inline void FreeRemote(Span* s, void* p);
+  always_inline bool BufferRemoteFree(Span* s, void* p);
+  always_inline void FlushRemoteFrees(RemoteFreeBatch* b);
+  always_inline void FlushAllRemoteFrees();
+  always_inline void FinishFree(Span* s,
+                                int32_t size_class,
+                                int32_t old_epoch,
+                                core_id old_owner,
+                                int32_t free_objects);
 
   void* core_link_;
   core_id id_;
+
+  // Links all cores, which are never destroyed.
+  Core* next_core_;
+  static std::atomic<Core*> all_cores_;
+  static std::atomic<bool> share_remote_frees_;
+
+  // Bytes left to allocate until the heap profiler takes the next sample.
+  int64_t sample_countdown_;
+
+  // Everything the allocation fast path touches (hot spans and object cache
+  // lengths) is packed densely into the first cache lines of a core.
   Span* hot_span_[kNumClasses];
-  Deque r_spans_[kNumClasses];
+
+  // Objects of small size classes that have already been taken from the
+  // corresponding hot span. Allocation pops them from the back.
+  int32_t object_cache_len_[kFineClasses];
+  void* object_cache_[kFineClasses][kObjectCacheSize];
+
+  // Objects freed to spans owned by other cores are linked up per span and
+  // returned to the span's remote free list in a single operation. A span maps
+  // to a fixed batch; a different span evicts (flushes) the batch. Once
+  // shared, the batches are guarded by the lock, which is only ever contended
+  // by the scavenger flushing the batches of idle cores. The flag is only
+  // changed while holding the lock.
+  RemoteFreeBatch remote_frees_[kRemoteFreeBatches];
+  int32_t remote_frees_pending_;
+  bool remote_frees_shared_;
+  RemoteFreesLock remote_frees_lock_;
+
+  // Reusable spans per size class. Most threads only use a few size classes,
+  // so a set is only allocated (and kept across reuse of the core) once the
+  // core first needs a span of its class.
+  ReusableSpans* r_spans_[kNumClasses];
+
+  CoreStats stats_;
 
   uint8_t pad_[128 - ((
       sizeof(core_link_) +
       sizeof(id_) +
-      sizeof(hot_span_)) % 128)];
+      sizeof(next_core_) +
+      sizeof(sample_countdown_) +
+      sizeof(hot_span_) +
+      sizeof(object_cache_len_) +
+      sizeof(object_cache_) +
+      sizeof(remote_frees_) +
+      sizeof(remote_frees_pending_) +
+      sizeof(remote_frees_shared_) +
+      sizeof(remote_frees_lock_) +
+      sizeof(r_spans_) +
+      sizeof(stats_)) % 128)];
 };
 
 #define FOR_ALL_CORE_FIELDS(V)                                                 \
   V(core_link_)                                                                \
   V(id_)                                                                       \
+  V(next_core_)                                                                \
+  V(sample_countdown_)                                                         \
   V(hot_span_)                                                                 \
+  V(object_cache_len_)                                                         \
+  V(object_cache_)                                                             \
+  V(remote_frees_)                                                             \
+  V(remote_frees_pending_)                                                     \
+  V(remote_frees_shared_)                                                      \
+  V(remote_frees_lock_)                                                        \
   V(r_spans_)                                                                  \
+  V(stats_)                                                                    \
+
+
+std::atomic<Core*> Core::all_cores_;
+std::atomic<bool> Core::share_remote_frees_;
 
 
 Core::Core() {
 #ifdef DEBUG
   CheckAlignments();
 #endif  // DEBUG
+  statistics.Register(&stats_);
+  Core* head = all_cores_.load();
+  do {
+    next_core_ = head;
+  } while (!all_cores_.compare_exchange_weak(head, this));
 }
 
 
@@ -80,22 +187,98 @@ FOR_ALL_CORE_FIELDS(CHECK_FIELD)
 
 void Core::Init(core_id id) {
   id_ = id;
+  {
+    RemoteFreesLock::Guard guard(remote_frees_lock_);
+    remote_frees_shared_ = share_remote_frees_.load();
+  }
   for (int32_t i = 0 ; i < kNumClasses; i++) {
-    r_spans_[i].Open(id);
+    if (r_spans_[i] != nullptr) {
+      r_spans_[i]->Open(id);
+    }
+  }
+}
+
+
+// Returns the reusable spans of a size class, allocating them on first use.
+// Returns nullptr if we are out of memory, in which case spans of the class are
+// not reused by this core.
+ReusableSpans* Core::GetReusableSpans(int32_t sc) {
+  if (LIKELY(r_spans_[sc] != nullptr)) {
+    return r_spans_[sc];
+  }
+  void* p = core_space.Allocate(sizeof(ReusableSpans));
+  if (p == nullptr) {
+    return nullptr;
+  }
+  ReusableSpans* rs = new(p) ReusableSpans();
+  rs->Open(id());
+  // Other cores only access the set through spans owned by this core, which
+  // are handed out after publishing the set.
+  r_spans_[sc] = rs;
+  return rs;
+}
+
+
+// Hands a hot span over to other cores before this core terminates. Spans
+// without any allocated objects are returned to the span pool instead.
+void Core::Orphan(Span* s) {
+  if (s->NrFreeObjects() == ClassToObjects[s->size_class()]) {
+    // Go through the full state, so that cores still finishing a free on the
+    // span observe a new epoch.
+    s->NewMarkFloating();
+    stats_.spans_floated[s->size_class()].Add(1);
+    bool linked;
+    const bool success = s->NewMarkFull(s->epoch(), &linked);
+    ScallocAssert(success && !linked);
+    DeleteSpan(s);
+    return;
+  }
+  orphan_spans.Put(s, id());
+}
+
+
+void Core::FlushObjectCache(int32_t sc) {
+  // Cached objects are still accounted as allocated in the hot span. Return
+  // them as local frees before the span leaves this core.
+  while (object_cache_len_[sc] > 0) {
+    hot_span_[sc]->Free(object_cache_[sc][--object_cache_len_[sc]], id());
   }
 }
 
 
 void Core::Destroy() {
+  for (size_t i = 0; i < kFineClasses; i++) {
+    FlushObjectCache(i);
+  }
+  FlushAllRemoteFrees();
+
   for (size_t i = 0; i < kNumClasses; i++) {
-    r_spans_[i].Close();
+    if (r_spans_[i] != nullptr) {
+      r_spans_[i]->Close();
+    }
 
     if (hot_span_[i] != nullptr) {
-      hot_span_[i]->NewMarkFloating();
+      Orphan(hot_span_[i]);
       hot_span_[i] = nullptr;
     }
 
-    r_spans_[i].RemoveAll();
+    if (r_spans_[i] == nullptr) {
+      continue;
+    }
+    DoubleListNode* node;
+    while ((node = r_spans_[i]->Pop()) != nullptr) {
+      Span* s = Span::FromSpanLink(node);
+      if (UnlinkSpan(s)) {
+        DeleteSpan(s);
+        continue;
+      }
+      // Spans that change state concurrently are left floating.
+      const int32_t epoch = s->epoch();
+      if ((s->owner() == id()) && s->NewMarkHot(epoch)) {
+        stats_.spans_revived[i].Add(1);
+        Orphan(s);
+      }
+    }
   }
 
   id_ = kTerminated;
@@ -103,30 +286,58 @@ void Core::Destroy() {
 
 
 Span* Core::GetSpan(int32_t sc) {
+  // Slow path anyways. Hand back buffered remote objects so that they don't go
+  // stale.
+  FlushAllRemoteFrees();
+
+  ReusableSpans* r_spans = GetReusableSpans(sc);
   Span* newspan = nullptr;
   DoubleListNode* node = nullptr;
-  while ((node = r_spans_[sc].RemoveBack()) != nullptr) {
+  while ((r_spans != nullptr) && ((node = r_spans->Pop()) != nullptr)) {
     newspan = Span::FromSpanLink(node);
+    if (UnlinkSpan(newspan)) {
+      // Got completely empty while waiting for reuse.
+      DeleteSpan(newspan);
+      newspan = nullptr;
+      continue;
+    }
     int32_t epoch = newspan->epoch();
-    if (newspan->NewMarkHot(epoch)) {
+    if ((newspan->owner() == id()) && newspan->NewMarkHot(epoch)) {
       ScallocAssert(newspan->owner() == id());
       newspan->MoveRemoteToLocalObjects();
+      stats_.spans_reused.Add(1);
+      stats_.spans_revived[sc].Add(1);
       break;
     }
     newspan = nullptr;
   }
+  if (newspan == nullptr) {
+    newspan = orphan_spans.Get(sc, id());
+    if (newspan != nullptr) {
+      stats_.spans_adopted.Add(1);
+    }
+  }
   if (newspan == nullptr) {
     newspan = Span::New(sc, id());
+    if (newspan != nullptr) {
+      stats_.spans_new[sc].Add(1);
+    }
   }
 #if defined(SCALLOC_NO_CLEANUP_IN_FREE)
   Span* cleanup_span = nullptr;
-  while ((node = r_spans_[sc].RemoveBack()) != nullptr) {
+  while ((r_spans != nullptr) && ((node = r_spans->Pop()) != nullptr)) {
     cleanup_span = Span::FromSpanLink(node);
+    if (UnlinkSpan(cleanup_span)) {
+      DeleteSpan(cleanup_span);
+      continue;
+    }
     const int32_t epoch = cleanup_span->epoch();
     if (cleanup_span->NrFreeObjects() == ClassToObjects[cleanup_span->size_class()]) {
-      const bool success = cleanup_span->NewMarkFull(epoch);
+      bool linked;
+      const bool success = cleanup_span->NewMarkFull(epoch, &linked);
       ScallocAssert(success);  // should always work
-      Span::Delete(cleanup_span);
+      ScallocAssert(!linked);
+      DeleteSpan(cleanup_span);
     }
   }
 #endif  // SCALLOC_NO_CLEANUP_IN_FREE
@@ -134,35 +345,138 @@ Span* Core::GetSpan(int32_t sc) {
 }
 
 
+void Core::DeleteSpan(Span* s) {
+  stats_.spans_deleted[s->size_class()].Add(1);
+  Span::Delete(s);
+}
+
+
+bool Core::UnlinkSpan(Span* s) {
+  stats_.spans_unlinked[s->size_class()].Add(1);
+  return s->Unlink();
+}
+
+
+void Core::CountAllocation(int32_t sc, size_t size) {
+  stats_.allocs[sc].objects.Add(1);
+  stats_.allocs[sc].requested_bytes.Add(size);
+}
+
+
+void* Core::AllocateFromHotSpan(int32_t sc, bool* zeroed) {
+  if (sc >= static_cast<int32_t>(kFineClasses)) {
+    if (zeroed != nullptr) {
+      return hot_span_[sc]->Allocate(zeroed);
+    }
+    return hot_span_[sc]->Allocate();
+  }
+  // Refill the cache in one go. The cache is only refilled when empty, so it
+  // never holds objects of any other span than the current hot span.
+  ScallocAssert(object_cache_len_[sc] == 0);
+  const int32_t n = hot_span_[sc]->AllocateBatch(
+      object_cache_[sc], kObjectCacheSize);
+  if (UNLIKELY(n == 0)) {
+    return nullptr;
+  }
+  object_cache_len_[sc] = n - 1;
+  return object_cache_[sc][n - 1];
+}
+
+
 void* Core::Allocate(size_t size) {
+  return Allocate(size, nullptr);
+}
+
+
+// Returns zeroed memory, only clearing objects that are not known to be zero
+// already.
+void* Core::AllocateZeroed(size_t size) {
+  bool zeroed = false;
+  void* obj = Allocate(size, &zeroed);
+  if ((obj != nullptr) && !zeroed) {
+    memset(obj, 0, size);
+  }
+  return obj;
+}
+
+
+// If zeroed is non-null it receives whether the returned object is known to
+// be zero. It is left untouched for objects that are not.
+void* Core::Allocate(size_t size, bool* zeroed) {
+#ifdef SCALLOC_HEAP_PROFILER
+  sample_countdown_ -= size;
+  if (UNLIKELY(sample_countdown_ < 0)) {
+    return AllocateSampled(size, zeroed);
+  }
+#endif  // SCALLOC_HEAP_PROFILER
+  return AllocateObject(size, zeroed);
+}
+
+
+#ifdef SCALLOC_HEAP_PROFILER
+// Cores start with an expired countdown, so their first allocation also picks
+// up the sampling interval.
+void* Core::AllocateSampled(size_t size, bool* zeroed) {
+  sample_countdown_ = heap_profiler.NextSampleInterval();
+  void* obj = AllocateObject(size, zeroed);
+  if ((obj != nullptr) && heap_profiler.Record(obj, size)) {
+    if (object_space.Contains(obj)) {
+      Span::FromObject(obj)->AddSample();
+    } else {
+      LargeObject::MarkSampled(obj);
+    }
+  }
+  return obj;
+}
+#endif  // SCALLOC_HEAP_PROFILER
+
+
+void* Core::AllocateObject(size_t size, bool* zeroed) {
   ScallocAssert(id() != kTerminated);
   const size_t sc = SizeToClass(size);
+  // Size class 0 never caches objects, so size 0 and large objects fall
+  // through.
+  if (LIKELY(sc < kFineClasses) && LIKELY(object_cache_len_[sc] > 0)) {
+    CountAllocation(sc, size);
+    return object_cache_[sc][--object_cache_len_[sc]];
+  }
   if (UNLIKELY(hot_span_[sc] == nullptr)) {
     if (UNLIKELY(sc == 0)) {
       // Could either be allocation for size 0, or a really large object.
       if (UNLIKELY(size == 0)) {
         return nullptr;
       }
+      if (zeroed != nullptr) {
+        return LargeObject::Allocate(size, zeroed);
+      }
       return LargeObject::Allocate(size);
     }
     hot_span_[sc] = GetSpan(sc);
+    if (UNLIKELY(hot_span_[sc] == nullptr)) {
+      errno = ENOMEM;
+      return nullptr;
+    }
   }
-  void* obj = hot_span_[sc]->Allocate();
+  void* obj = AllocateFromHotSpan(sc, zeroed);
   if (UNLIKELY(obj == nullptr)) {
     if (hot_span_[sc]->NrFreeObjects() > ClassToReuseThreshold[sc]) {
       hot_span_[sc]->MoveRemoteToLocalObjects();
-      obj = hot_span_[sc]->Allocate();
-      return obj;
+      obj = AllocateFromHotSpan(sc, zeroed);
     }
-
-    hot_span_[sc]->NewMarkFloating();
-    hot_span_[sc] = GetSpan(sc);
-    if (UNLIKELY(hot_span_[sc] == nullptr)) {
-      errno = ENOMEM;
-      return nullptr;
+    // Spans adopted from terminated cores may not have any free object left,
+    // so keep replacing the hot span until one serves the request.
+    while (obj == nullptr) {
+      hot_span_[sc]->NewMarkFloating();
+      stats_.spans_floated[sc].Add(1);
+      hot_span_[sc] = GetSpan(sc);
+      if (UNLIKELY(hot_span_[sc] == nullptr)) {
+        errno = ENOMEM;
+        return nullptr;
+      }
+      obj = AllocateFromHotSpan(sc, zeroed);
     }
-    obj = hot_span_[sc]->Allocate();
   }
+  CountAllocation(sc, size);
   return obj;
 }
 
@@ -170,15 +484,157 @@ void* Core::Allocate(size_t size) {
 void Core::Free(void* p) {
   ScallocAssert(id() != kTerminated);
   Span* s = Span::FromObject(p);
-  if (UNLIKELY(seen_memalign != 0)) {
-    p = s->AlignToBlockStart(p);
+
+  const int32_t size_class = s->size_class();
+  stats_.frees[size_class].Add(1);
+#ifdef SCALLOC_HEAP_PROFILER
+  if (UNLIKELY(s->HasSamples()) && heap_profiler.Remove(p)) {
+    s->RemoveSample();
   }
+#endif  // SCALLOC_HEAP_PROFILER
 
+  if (s->owner() != id()) {
+    FreeRemote(s, p);
+    return;
+  }
+
+  stats_.local_frees.Add(1);
   const int32_t old_epoch = s->epoch();
-  core_id old_owner = s->owner();
-  const int32_t size_class = s->size_class();
   const int32_t free_objects = s->Free(p, id());
+  FinishFree(s, size_class, old_epoch, id(), free_objects);
+}
+
+
+// Free for callers that know the size class of p, e.g., from a sized
+// deallocation. Avoids depending on the size class stored in the span header.
+void Core::Free(void* p, int32_t size_class) {
+  ScallocAssert(id() != kTerminated);
+  Span* s = Span::FromObject(p);
+  ScallocAssert(static_cast<int32_t>(s->size_class()) == size_class);
+  stats_.frees[size_class].Add(1);
+#ifdef SCALLOC_HEAP_PROFILER
+  if (UNLIKELY(s->HasSamples()) && heap_profiler.Remove(p)) {
+    s->RemoveSample();
+  }
+#endif  // SCALLOC_HEAP_PROFILER
+
+  if (s->owner() != id()) {
+    FreeRemote(s, p);
+    return;
+  }
 
+  stats_.local_frees.Add(1);
+  const int32_t old_epoch = s->epoch();
+  const int32_t free_objects = s->Free(p, id());
+  FinishFree(s, size_class, old_epoch, id(), free_objects);
+}
+
+
+void Core::FreeRemote(Span* s, void* p) {
+  stats_.remote_frees.Add(1);
+  bool flush_all;
+  if (LIKELY(!remote_frees_shared_)) {
+    flush_all = BufferRemoteFree(s, p);
+  } else {
+    RemoteFreesLock::Guard guard(remote_frees_lock_);
+    flush_all = BufferRemoteFree(s, p);
+  }
+  if (UNLIKELY(flush_all)) {
+    FlushAllRemoteFrees();
+  }
+}
+
+
+// Returns whether all buffered objects should be returned.
+bool Core::BufferRemoteFree(Span* s, void* p) {
+  const int32_t batch =
+      (reinterpret_cast<uintptr_t>(s) >> kVirtualSpanShift) %
+      kRemoteFreeBatches;
+  RemoteFreeBatch* b = &remote_frees_[batch];
+  if (UNLIKELY(b->span != s)) {
+    FlushRemoteFrees(b);
+    b->span = s;
+    b->tail = p;
+  }
+  *(reinterpret_cast<void**>(p)) = b->head;
+  b->head = p;
+  b->len++;
+  if (UNLIKELY(b->len == kRemoteFreeBatchSize)) {
+    FlushRemoteFrees(b);
+  }
+  return ++remote_frees_pending_ >= kRemoteFreeFlushInterval;
+}
+
+
+void Core::FlushRemoteFrees(RemoteFreeBatch* b) {
+  Span* s = b->span;
+  if (s == nullptr) {
+    return;
+  }
+  ScallocAssert(b->len > 0);
+  // Buffered objects are not yet accounted as free, hence the span cannot have
+  // been returned to the span pool in the meantime.
+  const int32_t old_epoch = s->epoch();
+  const core_id old_owner = s->owner();
+  const int32_t free_objects = s->FreeRemoteRange(b->head, b->tail, b->len);
+  b->span = nullptr;
+  b->head = nullptr;
+  b->tail = nullptr;
+  b->len = 0;
+  FinishFree(s, s->size_class(), old_epoch, old_owner, free_objects);
+}
+
+
+void Core::FlushAllRemoteFrees() {
+  RemoteFreesLock::Guard guard(remote_frees_lock_);
+  remote_frees_shared_ = share_remote_frees_.load();
+  for (int32_t i = 0; i < kRemoteFreeBatches; i++) {
+    FlushRemoteFrees(&remote_frees_[i]);
+  }
+  remote_frees_pending_ = 0;
+}
+
+
+// Takes over the batches of other cores without waiting for them, and flushes
+// them as if this core had freed the objects. Cores that are busy freeing are
+// skipped, as they flush on their own anyways. So are cores that do not guard
+// their batches yet.
+void Core::FlushRemoteFreesOfOtherCores() {
+  for (Core* c = all_cores_.load(); c != nullptr; c = c->next_core_) {
+    if ((c == this) || !c->remote_frees_lock_.TryLock()) {
+      continue;
+    }
+    RemoteFreeBatch batches[kRemoteFreeBatches];
+    const bool pending =
+        c->remote_frees_shared_ && (c->remote_frees_pending_ > 0);
+    if (pending) {
+      for (int32_t i = 0; i < kRemoteFreeBatches; i++) {
+        batches[i] = c->remote_frees_[i];
+        c->remote_frees_[i].span = nullptr;
+        c->remote_frees_[i].head = nullptr;
+        c->remote_frees_[i].tail = nullptr;
+        c->remote_frees_[i].len = 0;
+      }
+      c->remote_frees_pending_ = 0;
+    }
+    c->remote_frees_lock_.Unlock();
+    if (!pending) {
+      continue;
+    }
+    for (int32_t i = 0; i < kRemoteFreeBatches; i++) {
+      FlushRemoteFrees(&batches[i]);
+    }
+  }
+}
+
+
+// Handles the state transitions of a span after objects have been returned to
+// it. old_epoch and old_owner have to be read before the objects are freed.
+void Core::FinishFree(Span* s,
+                      int32_t size_class,
+                      int32_t old_epoch,
+                      core_id old_owner,
+                      int32_t free_objects) {
   if ((old_owner.value()->id() == kTerminated) ||
       (old_owner != old_owner.value()->id())) {
     if (s->TryReviveNew(old_owner, id())) {
@@ -191,25 +647,27 @@ void Core::Free(void* p) {
 #if !defined(SCALLOC_NO_CLEANUP_IN_FREE)
   if (UNLIKELY((free_objects == ClassToObjects[size_class]) &&
       Span::IsFloatingOrReusable(old_epoch))) {
-      if (s->NewMarkFull(old_epoch)) {
-        if (Span::IsReusable(old_epoch)) {
-          old_owner.value()->r_spans_[size_class].Remove(
-              old_owner, s->SpanLink());
-        }
+      bool linked;
+      if (s->NewMarkFull(old_epoch, &linked) && !linked) {
+        // Spans that are still linked are deleted by whoever unlinks them.
         ScallocAssert(!Span::IsHot(s->epoch()));
-        Span::Delete(s);
+        DeleteSpan(s);
       }
 #else
   if (false) {
 #endif  // !SCALLOC_NO_CLEANUP_IN_FREE
   } else if (UNLIKELY((free_objects > ClassToReuseThreshold[size_class]) &&
              !Span::IsReusable(old_epoch))) {
-      // For a terminated owner that is waiting we will still add it to the list
-      // to keep the code paths simple. (Yep, that's overhead in this rare
-      // case.)
+      // The owner may have terminated in the meantime, or never have set up
+      // its reusable spans, in which case the span stays unlinked.
+      ReusableSpans* r_spans = old_owner.value()->r_spans_[size_class];
       if (s->NewMarkReuse(old_epoch)) {
-        old_owner.value()->r_spans_[size_class].PushFront(
-            old_owner, s->SpanLink());
+        stats_.spans_linked[size_class].Add(1);
+        if (((r_spans == nullptr) ||
+             !r_spans->Push(old_owner, s->SpanLink())) &&
+            UnlinkSpan(s)) {
+          DeleteSpan(s);
+        }
       }
   }
 }
@@ -219,14 +677,18 @@ class GuardedCore : public Core {
  public:
   always_inline GuardedCore();
   always_inline void* Allocate(size_t size);
+  always_inline void* AllocateZeroed(size_t size);
   always_inline void Free(void* p);
+  always_inline void Free(void* p, int32_t size_class);
 
   always_inline bool InUse() { return in_use_ == 1; }
   always_inline void AnnounceNewThread() { num_threads_.fetch_add(1); }
 
  protected:
   always_inline void* AllocateLocked(size_t size);
+  always_inline void* AllocateZeroedLocked(size_t size);
   always_inline void FreeLocked(void* p);
+  always_inline void FreeLocked(void* p, int32_t size_class);
 
   always_inline void Acquire() { in_use_ = 1; }
   always_inline void Release() { in_use_ = 0; }
@@ -262,6 +724,19 @@ void* GuardedCore::Allocate(size_t size) {
 }
 
 
+void* GuardedCore::AllocateZeroed(size_t size) {
+  void* p;
+  Acquire();
+  if (LIKELY(num_threads_.load() == 1)) {
+    p = Core::AllocateZeroed(size);
+  } else {
+    p = AllocateZeroedLocked(size);
+  }
+  Release();
+  return p;
+}
+
+
 void GuardedCore::Free(void* p) {
   Acquire();
   if (LIKELY(num_threads_.load() == 1)) {
@@ -273,17 +748,105 @@ void GuardedCore::Free(void* p) {
 }
 
 
+void GuardedCore::Free(void* p, int32_t size_class) {
+  Acquire();
+  if (LIKELY(num_threads_.load() == 1)) {
+    Core::Free(p, size_class);
+  } else {
+    FreeLocked(p, size_class);
+  }
+  Release();
+}
+
+
 void* GuardedCore::AllocateLocked(size_t size) {
   Lock::Guard guard(core_lock_);
   return Core::Allocate(size);
 }
 
 
+void* GuardedCore::AllocateZeroedLocked(size_t size) {
+  Lock::Guard guard(core_lock_);
+  return Core::AllocateZeroed(size);
+}
+
+
 void GuardedCore::FreeLocked(void* p) {
   Lock::Guard guard(core_lock_);
   Core::Free(p);
 }
 
+
+void GuardedCore::FreeLocked(void* p, int32_t size_class) {
+  Lock::Guard guard(core_lock_);
+  Core::Free(p, size_class);
+}
+
+
+// A core that is shared by a changing set of threads, e.g., all threads
+// running on a CPU. All operations are serialized by a spin lock.
+class LockedCore : public Core {
+ public:
+  always_inline LockedCore() : Core() {}
+  always_inline void* Allocate(size_t size);
+  always_inline void* AllocateZeroed(size_t size);
+  always_inline int32_t AllocateBatch(size_t size, void** objs, int32_t n);
+  always_inline void Free(void* p);
+  always_inline void Free(void* p, int32_t size_class);
+  always_inline void FreeBatch(void** objs, int32_t n);
+
+ protected:
+  typedef SpinLock<64> Lock;
+
+  Lock core_lock_;
+};
+
+
+void* LockedCore::Allocate(size_t size) {
+  Lock::Guard guard(core_lock_);
+  return Core::Allocate(size);
+}
+
+
+void* LockedCore::AllocateZeroed(size_t size) {
+  Lock::Guard guard(core_lock_);
+  return Core::AllocateZeroed(size);
+}
+
+
+// Allocates up to n objects of the given size using a single lock acquisition.
+// Returns the number of allocated objects.
+int32_t LockedCore::AllocateBatch(size_t size, void** objs, int32_t n) {
+  Lock::Guard guard(core_lock_);
+  int32_t i = 0;
+  for (; i < n; i++) {
+    if ((objs[i] = Core::Allocate(size)) == nullptr) {
+      break;
+    }
+  }
+  return i;
+}
+
+
+void LockedCore::Free(void* p) {
+  Lock::Guard guard(core_lock_);
+  Core::Free(p);
+}
+
+
+void LockedCore::Free(void* p, int32_t size_class) {
+  Lock::Guard guard(core_lock_);
+  Core::Free(p, size_class);
+}
+
+
+void LockedCore::FreeBatch(void** objs, int32_t n) {
+  Lock::Guard guard(core_lock_);
+  for (int32_t i = 0; i < n; i++) {
+    Core::Free(objs[i]);
+  }
+}
+
 }  // namespace scalloc
 
 #undef FOR_ALL_CORE_FIELDS
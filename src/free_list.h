@@ -16,6 +16,8 @@ class IncrementalFreeList {
   always_inline IncrementalFreeList(intptr_t start, size_t size_class);
   always_inline int32_t Push(void* obj);
   always_inline void* Pop();
+  always_inline void* Pop(bool* fresh);
+  always_inline int32_t PopBatch(void** objs, int32_t max);
   always_inline void SetList(void* objs, size_t len);
 
   always_inline int_fast32_t Length() { return len_; }
@@ -66,6 +68,44 @@ void* IncrementalFreeList::Pop() {
   return result;
 }
 
+
+// Like Pop(), but additionally reports whether the object has been taken from
+// the bump pointer region, i.e., has never been handed out before.
+void* IncrementalFreeList::Pop(bool* fresh) {
+  *fresh = (list_ == NULL);
+  return Pop();
+}
+
+
+// Pops up to max objects into objs, returning the actual number of objects.
+// The objects are stored such that objs[n - 1] is the object Pop() would have
+// returned first, i.e., consumers should take them from the back.
+int32_t IncrementalFreeList::PopBatch(void** objs, int32_t max) {
+  int32_t n = 0;
+  while ((list_ != NULL) && (n < max)) {
+    objs[n++] = list_;
+    list_ = *(reinterpret_cast<void**>(list_));
+  }
+  if (list_ == NULL) {
+    // Only bump pointer objects left. Carve them without touching memory.
+    int32_t bump = len_ - n;
+    if (bump > (max - n)) {
+      bump = max - n;
+    }
+    for (int32_t i = 0; i < bump; i++) {
+      objs[n++] = reinterpret_cast<void*>(bump_pointer_);
+      bump_pointer_ += increment_;
+    }
+  }
+  len_ -= n;
+  for (int32_t i = 0, j = n - 1; i < j; i++, j--) {
+    void* tmp = objs[i];
+    objs[i] = objs[j];
+    objs[j] = tmp;
+  }
+  return n;
+}
+
 }  // namespace scalloc
 
 #endif  // SCALLOC_FREE_LIST_H_
@@ -6,19 +6,19 @@
 #define SCALLOC_GLOBALS_H_
 
 #include "platform/globals.h"
+#include "size_classes_raw.h"
 
 const size_t kPageSize = 4096;
 const uint64_t kPageNrMask = ~(static_cast<uint64_t>(kPageSize) - 1);
 const uint64_t kPageOffsetMask = static_cast<uint64_t>(kPageSize) - 1;
 
-const size_t kMaxThreads = 128;
-
 const uint64_t kKilo = 1UL << 10;
 const uint64_t kMega = kKilo * kKilo;
 const uint64_t kGiga = kMega * kKilo;
 const uint64_t kTera = kGiga * kKilo;
 
-const uint64_t kLABSpaceSize = 100 * kPageSize;
+// Cores are allocated from chunks of this size, as threads come and go.
+const uint64_t kLABChunkSize = 64 * kPageSize;
 const uint64_t kObjectSpaceSize = 35 * kTera;
 
 // TODO: Cleanup.
@@ -32,8 +32,8 @@ const size_t kMaxMediumSize = 1UL << kMaxMediumShift;
 const size_t kVirtualSpanSize = 1UL << kVirtualSpanShift;
 const uintptr_t kVirtualSpanMask = ~(kVirtualSpanSize - 1);
 const size_t kFineClasses = kMaxSmallSize / kMinAlignment + 1;
-const size_t kCoarseClasses = kMaxMediumShift - kMaxSmallShift;
-const int32_t kNumClasses = kFineClasses + kCoarseClasses;
+// kNumClasses depends on the size class geometry, see size_classes_raw.h.
+const size_t kCoarseClasses = kNumClasses - kFineClasses;
 
 namespace scalloc {
 
@@ -43,8 +43,90 @@ namespace scalloc {
 #define SCALLOC_REUSE_THRESHOLD (80)
 #endif  // SCALLOC_REUSE_THRESHOLD
 
+// Number of objects per small size class that a core takes from its hot span
+// at once.
+#ifndef SCALLOC_OBJECT_CACHE_SIZE
+#define SCALLOC_OBJECT_CACHE_SIZE (16)
+#endif  // SCALLOC_OBJECT_CACHE_SIZE
+
+// Maximum number of objects a core buffers for a single remote span before
+// returning them at once.
+#ifndef SCALLOC_REMOTE_FREE_BATCH_SIZE
+#define SCALLOC_REMOTE_FREE_BATCH_SIZE (32)
+#endif  // SCALLOC_REMOTE_FREE_BATCH_SIZE
+
+// Number of buffered remote frees after which a core returns all buffered
+// objects, bounding the time objects spend in buffers.
+#ifndef SCALLOC_REMOTE_FREE_FLUSH_INTERVAL
+#define SCALLOC_REMOTE_FREE_FLUSH_INTERVAL (1024)
+#endif  // SCALLOC_REMOTE_FREE_FLUSH_INTERVAL
+
+// Number of spans a core takes from another core's span pool backend at once.
+// The spans beyond the first one are moved to the core's own backend.
+#ifndef SCALLOC_SPAN_POOL_STEAL_BATCH
+#define SCALLOC_SPAN_POOL_STEAL_BATCH (4)
+#endif  // SCALLOC_SPAN_POOL_STEAL_BATCH
+
+// Maximum number of bytes held in freed large object mappings for reuse. A
+// value of 0 disables the large object cache.
+#ifndef SCALLOC_LARGE_OBJECT_CACHE_SIZE
+#define SCALLOC_LARGE_OBJECT_CACHE_SIZE (256UL << 20)
+#endif  // SCALLOC_LARGE_OBJECT_CACHE_SIZE
+
+// Large objects of at least 2^SCALLOC_LARGE_OBJECT_CACHE_MAX_SHIFT bytes are
+// never cached.
+#ifndef SCALLOC_LARGE_OBJECT_CACHE_MAX_SHIFT
+#define SCALLOC_LARGE_OBJECT_CACHE_MAX_SHIFT (27)
+#endif  // SCALLOC_LARGE_OBJECT_CACHE_MAX_SHIFT
+
+// Time (in ms) after which unused cached large object mappings are returned
+// to the system.
+#ifndef SCALLOC_LARGE_OBJECT_CACHE_DECAY
+#define SCALLOC_LARGE_OBJECT_CACHE_DECAY (1000)
+#endif  // SCALLOC_LARGE_OBJECT_CACHE_DECAY
+
+// Maximum number of live large objects that took over the pages of a medium
+// object when growing. Each of them occupies up to three memory mappings, which
+// count towards the system's limit (vm.max_map_count). Further objects are
+// copied instead.
+#ifndef SCALLOC_LARGE_OBJECT_MAX_MOVED
+#define SCALLOC_LARGE_OBJECT_MAX_MOVED (1024)
+#endif  // SCALLOC_LARGE_OBJECT_MAX_MOVED
+
+// Time (in ms) after which spans that have not been reused are returned to
+// the system by the background scavenger. A value of 0 disables the scavenger.
+// Can be changed at runtime using the environment variable
+// SCALLOC_SCAVENGER_DECAY or mallopt().
+#ifndef SCALLOC_SCAVENGER_DECAY
+#define SCALLOC_SCAVENGER_DECAY (0)
+#endif  // SCALLOC_SCAVENGER_DECAY
+
+// Maximum number of spans returned to the system by the scavenger per second.
+#ifndef SCALLOC_SCAVENGER_RATE
+#define SCALLOC_SCAVENGER_RATE (1024)
+#endif  // SCALLOC_SCAVENGER_RATE
+
+// Average number of bytes allocated between two samples of the heap profiler.
+// A value of 0 disables sampling. Can be changed at runtime using the
+// environment variable SCALLOC_PROFILE_SAMPLE_RATE or mallopt().
+#ifndef SCALLOC_PROFILE_SAMPLE_RATE
+#define SCALLOC_PROFILE_SAMPLE_RATE (0)
+#endif  // SCALLOC_PROFILE_SAMPLE_RATE
+
+// How memory of spans is returned to the system: MADV_DONTNEED drops pages
+// immediately, MADV_FREE lets the kernel reclaim them lazily under memory
+// pressure, and none keeps them. Can be changed at runtime using the
+// environment variable SCALLOC_PURGE (dontneed, free, none) or mallopt().
+#define SCALLOC_PURGE_DONTNEED 0
+#define SCALLOC_PURGE_FREE     1
+#define SCALLOC_PURGE_NONE     2
+#ifndef SCALLOC_PURGE
+#define SCALLOC_PURGE SCALLOC_PURGE_DONTNEED
+#endif  // SCALLOC_PURGE
+
 #define SCALLOC_LAB_MODEL_TLAB  0
 #define SCALLOC_LAB_MODEL_RR    1
+#define SCALLOC_LAB_MODEL_PERCPU 2
 #ifndef SCALLOC_LAB_MODEL
 #define SCALLOC_LAB_MODEL SCALLOC_LAB_MODEL_TLAB
 #endif  // SCALLOC_LAB_MODEL
@@ -53,11 +135,35 @@ namespace scalloc {
 #define SCALLOC_MADVISE 1
 #endif  // !SCALLOC_NO_MADVISE
 
-#ifndef SCALLOC_NO_MADVISE_EAGER
+// Huge page mode: Spans of all size classes fill their whole virtual span, and
+// the object space is backed by transparent huge pages, so that every span is
+// covered by a single TLB entry. Spans are only returned to the system as a
+// whole, i.e., eager madvise on free is disabled.
+#if defined(SCALLOC_HUGE_PAGES) && defined(SCALLOC_DISABLE_TRANSPARENT_HUGEPAGES)
+#error "SCALLOC_HUGE_PAGES requires transparent huge pages"
+#endif  // SCALLOC_HUGE_PAGES && SCALLOC_DISABLE_TRANSPARENT_HUGEPAGES
+
+#ifndef SCALLOC_NO_HEAP_PROFILER
+#define SCALLOC_HEAP_PROFILER 1
+#endif  // !SCALLOC_NO_HEAP_PROFILER
+
+#if !defined(SCALLOC_NO_MADVISE_EAGER) && !defined(SCALLOC_HUGE_PAGES)
 #define SCALLOC_MADVISE_EAGER 1
-#endif  // !SCALLOC_NO_MADVISE_EAGER
+#endif  // !SCALLOC_NO_MADVISE_EAGER && !SCALLOC_HUGE_PAGES
 
 const int32_t kReuseThreshold = SCALLOC_REUSE_THRESHOLD;
+const int32_t kObjectCacheSize = SCALLOC_OBJECT_CACHE_SIZE;
+const int32_t kRemoteFreeBatchSize = SCALLOC_REMOTE_FREE_BATCH_SIZE;
+const int32_t kRemoteFreeFlushInterval = SCALLOC_REMOTE_FREE_FLUSH_INTERVAL;
+const int32_t kRemoteFreeBatches = 8;
+const int32_t kSpanPoolStealBatch = SCALLOC_SPAN_POOL_STEAL_BATCH;
+const size_t kLargeObjectCacheSize = SCALLOC_LARGE_OBJECT_CACHE_SIZE;
+const int32_t kLargeObjectCacheMaxShift = SCALLOC_LARGE_OBJECT_CACHE_MAX_SHIFT;
+const uint64_t kLargeObjectCacheDecay = SCALLOC_LARGE_OBJECT_CACHE_DECAY;
+const int32_t kLargeObjectMaxMoved = SCALLOC_LARGE_OBJECT_MAX_MOVED;
+const uint64_t kScavengerDecay = SCALLOC_SCAVENGER_DECAY;
+const int32_t kScavengerRate = SCALLOC_SCAVENGER_RATE;
+const int32_t kPurgeStrategy = SCALLOC_PURGE;
 
 #if SCALLOC_LAB_MODEL == SCALLOC_LAB_MODEL_TLAB
 class ThreadLocalAllocationBuffer;
@@ -65,16 +171,32 @@ typedef ThreadLocalAllocationBuffer ABProvider;
 #elif SCALLOC_LAB_MODEL == SCALLOC_LAB_MODEL_RR
 class RoundRobinAllocationBuffer;
 typedef RoundRobinAllocationBuffer ABProvider;
+#elif SCALLOC_LAB_MODEL == SCALLOC_LAB_MODEL_PERCPU
+class PerCpuAllocationBuffer;
+typedef PerCpuAllocationBuffer ABProvider;
 #else
 #error "unknown LAB model"
 #endif  // SCALLOC_LAB_MODEL
 
 class Arena;
+class ChunkedArena;
+class HeapProfiler;
+class LargeObjectCache;
+class OrphanSpans;
+class Scavenger;
 class SpanPool;
+class Statistics;
+class Tracer;
 
 extern Arena object_space;
-extern Arena core_space;
+extern ChunkedArena core_space;
 extern SpanPool span_pool;
+extern LargeObjectCache large_object_cache;
+extern OrphanSpans orphan_spans;
+extern HeapProfiler heap_profiler;
+extern Scavenger scavenger;
+extern Statistics statistics;
+extern Tracer tracer;
 extern ABProvider ab_scheduler;
 
 }  // namespace scalloc
@@ -5,23 +5,57 @@
 #include "glue.h"
 
 #include <errno.h>
+#include <fcntl.h>
 #include <stdlib.h>
 #include <string.h>
+#include <unistd.h>
+
+#include <new>
 
 #include "arena.h"
 #include "globals.h"
+#include "heap_profiler.h"
 #include "lab.h"
+#include "large_object_cache.h"
 #include "log.h"
+#include "orphan_spans.h"
+#ifdef SCALLOC_NUMA
+#include "platform/numa.h"
+#endif  // SCALLOC_NUMA
 #include "platform/override.h"
 #include "size_classes_raw.h"
 #include "size_classes.h"
 #include "span_pool.h"
+#include "stats.h"
+#include "trace.h"
 
 
 namespace scalloc {
 
+// Blocks of small size classes start right after the span header. Blocks of
+// medium size classes start at an offset of their block size, which aligns
+// them to the largest power of two dividing the block size.
+#define BLOCK_OFFSET(size)                                                     \
+  (((size) > static_cast<int32_t>(kMaxSmallSize)) ? (size) : kSpanHeaderSize)
+
+#ifdef SCALLOC_HUGE_PAGES
+// Spans fill their whole virtual span, i.e., one (transparent) huge page.
+// Remote free lists count objects in 16 bit tags, which caps the number of
+// objects of the smallest size class.
+#define HUGE_OBJECTS(size)                                                     \
+  ((static_cast<int32_t>(kVirtualSpanSize) - BLOCK_OFFSET(size)) /            \
+   ((size) == 0 ? 1 : (size)))
+#define SPAN_SIZE_OF(b, c)                                                     \
+  (((b) == 0) ? 0 : static_cast<int32_t>(kVirtualSpanSize))
+#define OBJECTS_OF(b, d)                                                       \
+  (((b) == 0) ? 0 : ((HUGE_OBJECTS(b) > 65535) ? 65535 : HUGE_OBJECTS(b)))
+#else
+#define SPAN_SIZE_OF(b, c) (c)
+#define OBJECTS_OF(b, d) (d)
+#endif  // SCALLOC_HUGE_PAGES
+
 cache_aligned const int32_t ClassToObjects[] = {
-#define NR_OBJECTS(a, b, c, d) (d),
+#define NR_OBJECTS(a, b, c, d) OBJECTS_OF(b, d),
 FOR_ALL_SIZE_CLASSES(NR_OBJECTS)
 #undef NR_OBJECTS
 };
@@ -33,51 +67,255 @@ FOR_ALL_SIZE_CLASSES(OBJECT_SIZE)
 };
 
 cache_aligned const int32_t ClassToSpanSize[] = {
-#define SPAN_SIZE(a, b, c, d) (c),
+#define SPAN_SIZE(a, b, c, d) SPAN_SIZE_OF(b, c),
 FOR_ALL_SIZE_CLASSES(SPAN_SIZE)
 #undef SPAN_SIZE
 };
 
+cache_aligned const int32_t ClassToBlockOffset[] = {
+#define OFFSET(a, b, c, d) BLOCK_OFFSET(b),
+FOR_ALL_SIZE_CLASSES(OFFSET)
+#undef OFFSET
+};
+
+// The largest power of two that all blocks of a size class are aligned to.
+cache_aligned const int32_t ClassToAlignment[] = {
+#define ALIGNMENT(a, b, c, d) \
+  ((BLOCK_OFFSET(b) | (b)) & -(BLOCK_OFFSET(b) | (b))),
+FOR_ALL_SIZE_CLASSES(ALIGNMENT)
+#undef ALIGNMENT
+};
+
 cache_aligned const int32_t ClassToReuseThreshold[] = {
-#define REUSE_TH(a, b, c, d) (((d) * kReuseThreshold)/100),
+#define REUSE_TH(a, b, c, d) ((OBJECTS_OF(b, d) * kReuseThreshold)/100),
 FOR_ALL_SIZE_CLASSES(REUSE_TH)
 #undef REUSE_TH
 };
 
+#ifdef SCALLOC_HUGE_PAGES
+#undef HUGE_OBJECTS
+#endif  // SCALLOC_HUGE_PAGES
+#undef OBJECTS_OF
+#undef SPAN_SIZE_OF
+#undef BLOCK_OFFSET
+
 // Be careful with order here! Since we define all globals in a single
 // translation unit we can rely on order.
 
-cache_aligned Arena core_space;
+cache_aligned Statistics statistics;
+cache_aligned ChunkedArena core_space;
 cache_aligned Arena object_space;
 cache_aligned SpanPool span_pool;
+cache_aligned LargeObjectCache large_object_cache;
+cache_aligned OrphanSpans orphan_spans;
+#ifdef SCALLOC_HEAP_PROFILER
+cache_aligned HeapProfiler heap_profiler;
+#endif  // SCALLOC_HEAP_PROFILER
+#ifdef SCALLOC_TRACE
+cache_aligned Tracer tracer;
+#endif  // SCALLOC_TRACE
+cache_aligned Scavenger scavenger;
 cache_aligned ABProvider ab_scheduler;
 cache_aligned ScallocGuard StartupExitHook;
 /*cache_aligned*/ int32_t ScallocGuardRefcount;
-/*cache_aligned*/ int32_t seen_memalign;
-
-#ifdef PROFILE
-cache_aligned std::atomic<int32_t> local_frees;
-cache_aligned std::atomic<int32_t> remote_frees;
-#endif  // PROFILE
 
 void exitHandler() {
+#ifdef SCALLOC_TRACE
+  tracer.Flush();
+#endif  // SCALLOC_TRACE
 #ifdef PROFILE
   span_pool.PrintProfileSummary();
-  LOG(kWarning, "free summary: local: %d, remote: %d",
-      local_frees.load(), remote_frees.load());
+  large_object_cache.PrintProfileSummary();
+  orphan_spans.PrintProfileSummary();
+  statistics.Print();
 #endif   // PROFILE
 }
 
 
+// Returns the resident set size of the process, or 0 if it is unknown. Avoids
+// stdio, which may allocate.
+static uint64_t ResidentBytes() {
+  const int fd = open("/proc/self/statm", O_RDONLY);
+  if (fd < 0) {
+    return 0;
+  }
+  char buf[128];
+  const ssize_t n = read(fd, buf, sizeof(buf) - 1);
+  close(fd);
+  if (n <= 0) {
+    return 0;
+  }
+  buf[n] = '\0';
+  // Second field: resident pages.
+  const char* resident = strchr(buf, ' ');
+  if (resident == nullptr) {
+    return 0;
+  }
+  return strtoull(resident + 1, nullptr, 10) * sysconf(_SC_PAGESIZE);
+}
+
+
+// Counters are summed up as signed values: counters of different cores are
+// read at different times, so a span may, e.g., show up as deleted but not yet
+// as created.
+static uint64_t NonNegative(int64_t value) {
+  return (value > 0) ? value : 0;
+}
+
+
+void Statistics::Collect(struct scalloc_stats* stats) {
+  memset(stats, 0, sizeof(*stats));
+  stats->num_classes = kNumClasses;
+  int64_t live_spans[kNumClasses] = { 0 };
+  int64_t hot_spans[kNumClasses] = { 0 };
+  int64_t linked_spans[kNumClasses] = { 0 };
+  for (CoreStats* cs = head_.load(); cs != nullptr; cs = cs->next) {
+    for (int32_t i = 0; i < kNumClasses; i++) {
+      scalloc_size_class_stats* c = &stats->classes[i];
+      c->allocs += cs->allocs[i].objects.Get();
+      c->frees += cs->frees[i].Get();
+      c->requested_bytes += cs->allocs[i].requested_bytes.Get();
+      stats->spans_new += cs->spans_new[i].Get();
+      stats->spans_deleted += cs->spans_deleted[i].Get();
+      live_spans[i] += cs->spans_new[i].Get() - cs->spans_deleted[i].Get();
+      hot_spans[i] += cs->spans_new[i].Get() + cs->spans_revived[i].Get() -
+                      cs->spans_floated[i].Get();
+      linked_spans[i] +=
+          cs->spans_linked[i].Get() - cs->spans_unlinked[i].Get();
+    }
+    stats->local_frees += cs->local_frees.Get();
+    stats->remote_frees += cs->remote_frees.Get();
+    stats->spans_reused += cs->spans_reused.Get();
+    stats->spans_adopted += cs->spans_adopted.Get();
+  }
+  for (int32_t i = 0; i < kNumClasses; i++) {
+    scalloc_size_class_stats* c = &stats->classes[i];
+    c->block_size = ClassToSize[i];
+    c->span_size = ClassToSpanSize[i];
+    c->objects_per_span = ClassToObjects[i];
+    c->live_objects = NonNegative(c->allocs - c->frees);
+    c->live_spans = NonNegative(live_spans[i]);
+    c->live_bytes = c->live_objects * c->block_size;
+    c->free_objects =
+        NonNegative(c->live_spans * c->objects_per_span - c->live_objects);
+    c->hot_spans = NonNegative(hot_spans[i]);
+    c->reusable_spans = NonNegative(linked_spans[i]);
+    c->floating_spans =
+        NonNegative(c->live_spans - c->hot_spans - c->reusable_spans);
+    stats->allocs += c->allocs;
+    stats->frees += c->frees;
+    stats->live_bytes += c->live_bytes;
+    stats->span_bytes += c->live_spans * c->span_size;
+  }
+  stats->madvise_calls = span_pool.madvise_calls();
+  stats->rss_bytes = ResidentBytes();
+  stats->large_allocs = large_allocs_.load();
+  stats->large_frees = large_frees_.load();
+  const int64_t large_objects = large_objects_.load();
+  const int64_t large_bytes = large_bytes_.load();
+  stats->large_objects = (large_objects > 0) ? large_objects : 0;
+  stats->large_bytes = (large_bytes > 0) ? large_bytes : 0;
+}
+
+
+void Statistics::Print() {
+  struct scalloc_stats stats;
+  Collect(&stats);
+  fprintf(stderr, "scalloc statistics\n"
+          "objects: allocs: %lu, frees: %lu (local: %lu, remote: %lu)\n"
+          "spans: new: %lu, reused: %lu, adopted: %lu, deleted: %lu, "
+          "madvise: %lu\n"
+          "in use: %lu bytes in %lu bytes of spans\n"
+          "large objects: %lu (%lu bytes), allocs: %lu, frees: %lu\n"
+          "resident: %lu bytes\n",
+          stats.allocs, stats.frees, stats.local_frees, stats.remote_frees,
+          stats.spans_new, stats.spans_reused, stats.spans_adopted,
+          stats.spans_deleted, stats.madvise_calls,
+          stats.live_bytes, stats.span_bytes,
+          stats.large_objects, stats.large_bytes,
+          stats.large_allocs, stats.large_frees,
+          stats.rss_bytes);
+  fprintf(stderr, "%5s %10s %14s %14s %12s %14s %8s\n",
+          "class", "block size", "allocs", "frees", "live objects",
+          "live bytes", "spans");
+  for (uint32_t i = 1; i < stats.num_classes; i++) {
+    const scalloc_size_class_stats& c = stats.classes[i];
+    if (c.allocs == 0) {
+      continue;
+    }
+    fprintf(stderr, "%5u %10lu %14lu %14lu %12lu %14lu %8lu\n",
+            i, c.block_size, c.allocs, c.frees, c.live_objects,
+            c.live_bytes, c.live_spans);
+  }
+
+  // Internal waste is the share of allocated block bytes that has not been
+  // requested. Free objects of live spans are external fragmentation; spans
+  // with more free objects than the reuse threshold get reused.
+  fprintf(stderr, "fragmentation (reuse threshold: %d%%)\n", kReuseThreshold);
+  fprintf(stderr, "%5s %10s %12s %6s %8s %8s %8s %10s %10s\n",
+          "class", "block size", "avg request", "waste", "hot", "reusable",
+          "floating", "free/span", "threshold");
+  for (uint32_t i = 1; i < stats.num_classes; i++) {
+    const scalloc_size_class_stats& c = stats.classes[i];
+    if (c.allocs == 0) {
+      continue;
+    }
+    const uint64_t block_bytes = c.allocs * c.block_size;
+    const uint64_t waste = (block_bytes > c.requested_bytes) ?
+        block_bytes - c.requested_bytes : 0;
+    fprintf(stderr, "%5u %10lu %12lu %5lu%% %8lu %8lu %8lu %10lu %10d\n",
+            i, c.block_size, c.requested_bytes / c.allocs,
+            (waste * 100) / block_bytes,
+            c.hot_spans, c.reusable_spans, c.floating_spans,
+            (c.live_spans > 0) ? (c.free_objects / c.live_spans) : 0,
+            ClassToReuseThreshold[i]);
+  }
+}
+
+
+// Orphaned spans are owned by a core that is never used for allocation.
+static void InitOrphanSpans() {
+  void* p = core_space.Allocate(sizeof(Core));
+  if (p == nullptr) {
+    Fatal("out of memory for orphan spans.");
+  }
+  Core* owner = new(p) Core();
+  owner->Init(core_id(owner, 0));
+  orphan_spans.Init(owner);
+}
+
+
 static void ScallocInit() {
-  core_space.Init(kLABSpaceSize, kPageSize, "LAB");
+  statistics.Init();
+  core_space.Init(kLABChunkSize, "LAB");
+#ifdef SCALLOC_HEAP_PROFILER
+  heap_profiler.Init();
+#endif  // SCALLOC_HEAP_PROFILER
+#ifdef SCALLOC_TRACE
+  tracer.Init();
+#endif  // SCALLOC_TRACE
   object_space.Init(kObjectSpaceSize, kObjectSpaceSize, "object");
+#ifdef SCALLOC_NUMA
+  object_space.Partition(NumaNodes());
+#endif  // SCALLOC_NUMA
   span_pool.Init();
+  large_object_cache.Init();
+  InitOrphanSpans();
   ab_scheduler.Init();
 
   ab_scheduler.GetMeALAB();
   ReplaceSystemAllocator();
   atexit(exitHandler);
+
+  large_object_cache.InstallForkHandlers();
+  // Start threads, hence only after everything else has been set up.
+  scavenger.Init();
+#ifdef SCALLOC_HEAP_PROFILER
+  heap_profiler.InstallSignalHandler();
+#endif  // SCALLOC_HEAP_PROFILER
+#ifdef SCALLOC_TRACE
+  tracer.StartWriter();
+#endif  // SCALLOC_TRACE
 }
 
 
@@ -90,6 +328,102 @@ scalloc::ScallocGuard::ScallocGuard() {
 scalloc::ScallocGuard::~ScallocGuard() {
 }
 
+
+always_inline void EnsureInitialized() {
+#ifdef SCALLOC_NO_SAFE_GLOBAL_CONSTRUCTION
+  // Since we don't have global initialization dependencies we need to make sure
+  // to check whether all components already have been initialized. (e.g. in C++
+  // a global variable in a different translation unit can call a runtime
+  // function, effectively yielding in an allocation call)
+  if (UNLIKELY(ScallocGuardRefcount == 0)) {
+    ScallocGuardRefcount++;
+    ScallocInit();
+  }
+#endif  // SCALLOC_NO_SAFE_GLOBAL_CONSTRUCTION
+}
+
+
+// Allocation for C++ operator new. Unlike malloc(), operator new never returns
+// NULL (also not for size 0) but calls the installed new handler until the
+// request can be served.
+always_inline void* cpp_new(size_t size) {
+  EnsureInitialized();
+  if (UNLIKELY(size == 0)) {
+    size = 1;
+  }
+  void* p;
+  while (UNLIKELY((p = malloc(size)) == nullptr)) {
+    std::new_handler handler = std::get_new_handler();
+    if (handler == nullptr) {
+      Fatal("operator new: out of memory for size %lu", size);
+    }
+    handler();
+  }
+  TraceAllocation(SCALLOC_TRACE_MALLOC, p, size, 0);
+  return p;
+}
+
+
+always_inline void* cpp_new_nothrow(size_t size) {
+  EnsureInitialized();
+  if (UNLIKELY(size == 0)) {
+    size = 1;
+  }
+  void* p = malloc(size);
+  TraceAllocation(SCALLOC_TRACE_MALLOC, p, size, 0);
+  return p;
+}
+
+
+always_inline void* cpp_new_aligned(size_t size, size_t alignment) {
+  EnsureInitialized();
+  void* p;
+  while (UNLIKELY((p = memalign(alignment, size ? size : 1)) == nullptr)) {
+    std::new_handler handler = std::get_new_handler();
+    if (handler == nullptr) {
+      Fatal("operator new: out of memory for size %lu, alignment %lu",
+            size, alignment);
+    }
+    handler();
+  }
+  TraceAllocation(SCALLOC_TRACE_MEMALIGN, p, size, alignment);
+  return p;
+}
+
+
+always_inline void* cpp_new_aligned_nothrow(size_t size, size_t alignment) {
+  EnsureInitialized();
+  void* p = memalign(alignment, size ? size : 1);
+  TraceAllocation(SCALLOC_TRACE_MEMALIGN, p, size, alignment);
+  return p;
+}
+
+
+always_inline void cpp_delete(void* p) {
+  TraceFree(p);
+  free(p);
+}
+
+
+always_inline void cpp_delete_sized(void* p, size_t size) {
+  if (UNLIKELY(p == nullptr)) {
+    return;
+  }
+  TraceFree(p);
+  free_sized(p, size);
+}
+
+
+always_inline void cpp_delete_aligned_sized(void* p,
+                                            size_t alignment,
+                                            size_t size) {
+  if (UNLIKELY(p == nullptr)) {
+    return;
+  }
+  TraceFree(p);
+  free_aligned_sized(p, alignment, size);
+}
+
 }  // namespace scalloc
 
 
@@ -99,57 +433,83 @@ scalloc::ScallocGuard::~ScallocGuard() {
 
 extern "C" {
 void* scalloc_malloc(size_t size) __THROW {
-#ifdef SCALLOC_NO_SAFE_GLOBAL_CONSTRUCTION
-  // Since we don't have global initialization dependencies we need to make sure
-  // to check whether all components already have been initialized. (e.g. in C++
-  // a global variable in a different translation unit can call a runtime
-  // function, effectively yielding in an allocation call)
-  if (UNLIKELY(scalloc::ScallocGuardRefcount == 0)) {
-    scalloc::ScallocGuardRefcount++;
-    scalloc::ScallocInit();
-  }
-#endif  // SCALLOC_NO_SAFE_GLOBAL_CONSTRUCTION
-  return scalloc::malloc(size);
+  scalloc::EnsureInitialized();
+  void* p = scalloc::malloc(size);
+  scalloc::TraceAllocation(SCALLOC_TRACE_MALLOC, p, size, 0);
+  return p;
 }
 
 
 void scalloc_free(void* p) __THROW {
+  scalloc::TraceFree(p);
   scalloc::free(p);
 }
 
 
+void scalloc_free_sized(void* p, size_t size) __THROW {
+  scalloc::TraceFree(p);
+  scalloc::free_sized(p, size);
+}
+
+
+void scalloc_free_aligned_sized(void* p, size_t alignment, size_t size) __THROW {
+  scalloc::TraceFree(p);
+  scalloc::free_aligned_sized(p, alignment, size);
+}
+
+
 void* scalloc_calloc(size_t nmemb, size_t size) __THROW {
-  return scalloc::calloc(nmemb, size);
+  void* p = scalloc::calloc(nmemb, size);
+  scalloc::TraceAllocation(SCALLOC_TRACE_CALLOC, p, nmemb * size, 0);
+  return p;
 }
 
 
 void* scalloc_realloc(void* ptr, size_t size) __THROW {
-  return scalloc::realloc(ptr, size);
+  void* p = scalloc::realloc(ptr, size);
+  // Shrinking to size 0 keeps the object as is.
+  if (size != 0) {
+    scalloc::TraceRealloc(ptr, p, size);
+  }
+  return p;
 }
 
 
 void* scalloc_memalign(size_t __alignment, size_t __size) __THROW {
-  return scalloc::memalign(__alignment, __size);
+  void* p = scalloc::memalign(__alignment, __size);
+  scalloc::TraceAllocation(SCALLOC_TRACE_MEMALIGN, p, __size, __alignment);
+  return p;
 }
 
 
 void* scalloc_aligned_alloc(size_t alignment, size_t size) __THROW {
-  return scalloc::aligned_alloc(alignment, size);
+  void* p = scalloc::aligned_alloc(alignment, size);
+  scalloc::TraceAllocation(SCALLOC_TRACE_MEMALIGN, p, size, alignment);
+  return p;
 }
 
 
 int scalloc_posix_memalign(void** ptr, size_t align, size_t size) __THROW {
-  return scalloc::posix_memalign(ptr, align, size);
+  const int ret = scalloc::posix_memalign(ptr, align, size);
+  if (ret == 0) {
+    scalloc::TraceAllocation(SCALLOC_TRACE_MEMALIGN, *ptr, size, align);
+  }
+  return ret;
 }
 
 
 void* scalloc_valloc(size_t __size) __THROW {
-  return scalloc::valloc(__size);
+  void* p = scalloc::valloc(__size);
+  scalloc::TraceAllocation(SCALLOC_TRACE_MEMALIGN, p, __size, kPageSize);
+  return p;
 }
 
 
 void* scalloc_pvalloc(size_t __size) __THROW {
-  return scalloc::pvalloc(__size);
+  void* p = scalloc::pvalloc(__size);
+  scalloc::TraceAllocation(SCALLOC_TRACE_MEMALIGN, p,
+                           scalloc::PadSize(__size, kPageSize), kPageSize);
+  return p;
 }
 
 
@@ -158,6 +518,29 @@ void scalloc_malloc_stats() __THROW {
 }
 
 
+#ifdef SCALLOC_HAVE_MALLINFO2
+struct mallinfo2 scalloc_mallinfo2() __THROW {
+  return scalloc::mallinfo2();
+}
+#endif  // SCALLOC_HAVE_MALLINFO2
+
+
+void scalloc_stats(struct scalloc_stats* stats) {
+  scalloc::EnsureInitialized();
+  scalloc::statistics.Collect(stats);
+}
+
+
+int scalloc_heap_profile_dump(const char* path) {
+#ifdef SCALLOC_HEAP_PROFILER
+  scalloc::EnsureInitialized();
+  return scalloc::heap_profiler.Dump(path);
+#else
+  return ENOSYS;
+#endif  // SCALLOC_HEAP_PROFILER
+}
+
+
 int scalloc_mallopt(int cmd, int value) __THROW {
   return scalloc::mallopt(cmd, value);
 }
@@ -171,3 +554,129 @@ void* scalloc_thread_start(void* arg) {
   return fake_args.real_start(fake_args.real_args);
 }
 }
+
+
+// C++ allocation operators. Defining them here (instead of relying on the
+// runtime's versions that wrap malloc() and free()) puts them directly on the
+// allocator's fast path.
+
+void* operator new(size_t size) {
+  return scalloc::cpp_new(size);
+}
+
+
+void* operator new[](size_t size) {
+  return scalloc::cpp_new(size);
+}
+
+
+void* operator new(size_t size, const std::nothrow_t&) noexcept {
+  return scalloc::cpp_new_nothrow(size);
+}
+
+
+void* operator new[](size_t size, const std::nothrow_t&) noexcept {
+  return scalloc::cpp_new_nothrow(size);
+}
+
+
+void operator delete(void* p) noexcept {
+  scalloc::cpp_delete(p);
+}
+
+
+void operator delete[](void* p) noexcept {
+  scalloc::cpp_delete(p);
+}
+
+
+void operator delete(void* p, const std::nothrow_t&) noexcept {
+  scalloc::cpp_delete(p);
+}
+
+
+void operator delete[](void* p, const std::nothrow_t&) noexcept {
+  scalloc::cpp_delete(p);
+}
+
+
+// C++14 sized deallocation.
+
+void operator delete(void* p, size_t size) noexcept {
+  scalloc::cpp_delete_sized(p, size);
+}
+
+
+void operator delete[](void* p, size_t size) noexcept {
+  scalloc::cpp_delete_sized(p, size);
+}
+
+
+#if defined(__cpp_aligned_new)
+// C++17 over-aligned allocation.
+
+void* operator new(size_t size, std::align_val_t alignment) {
+  return scalloc::cpp_new_aligned(size, static_cast<size_t>(alignment));
+}
+
+
+void* operator new[](size_t size, std::align_val_t alignment) {
+  return scalloc::cpp_new_aligned(size, static_cast<size_t>(alignment));
+}
+
+
+void* operator new(size_t size,
+                   std::align_val_t alignment,
+                   const std::nothrow_t&) noexcept {
+  return scalloc::cpp_new_aligned_nothrow(
+      size, static_cast<size_t>(alignment));
+}
+
+
+void* operator new[](size_t size,
+                     std::align_val_t alignment,
+                     const std::nothrow_t&) noexcept {
+  return scalloc::cpp_new_aligned_nothrow(
+      size, static_cast<size_t>(alignment));
+}
+
+
+void operator delete(void* p, std::align_val_t alignment) noexcept {
+  scalloc::cpp_delete(p);
+}
+
+
+void operator delete[](void* p, std::align_val_t alignment) noexcept {
+  scalloc::cpp_delete(p);
+}
+
+
+void operator delete(void* p,
+                     std::align_val_t alignment,
+                     const std::nothrow_t&) noexcept {
+  scalloc::cpp_delete(p);
+}
+
+
+void operator delete[](void* p,
+                       std::align_val_t alignment,
+                       const std::nothrow_t&) noexcept {
+  scalloc::cpp_delete(p);
+}
+
+
+void operator delete(void* p,
+                     size_t size,
+                     std::align_val_t alignment) noexcept {
+  scalloc::cpp_delete_aligned_sized(
+      p, static_cast<size_t>(alignment), size);
+}
+
+
+void operator delete[](void* p,
+                       size_t size,
+                       std::align_val_t alignment) noexcept {
+  scalloc::cpp_delete_aligned_sized(
+      p, static_cast<size_t>(alignment), size);
+}
+#endif  // __cpp_aligned_new
@@ -9,18 +9,27 @@
 #include <stdlib.h>
 #include <string.h>
 
+#if defined(__GLIBC__)
+#include <malloc.h>
+#if __GLIBC_PREREQ(2, 33)
+#define SCALLOC_HAVE_MALLINFO2 1
+#endif  // __GLIBC_PREREQ(2, 33)
+#endif  // __GLIBC__
+
 #include "arena.h"
 #include "globals.h"
+#include "heap_profiler.h"
 #include "lab.h"
 #include "large-objects.h"
 #include "log.h"
+#include "scavenger.h"
 #include "size_classes.h"
 #include "span.h"
+#include "span_pool.h"
+#include "stats.h"
 
 namespace scalloc {
 
-extern int seen_memalign;
-
 class ScallocGuard {
  public:
   always_inline ScallocGuard();
@@ -55,17 +64,51 @@ always_inline void free(void* p) {
 }
 
 
+// Sized deallocation: size has to be the size requested when allocating p. As
+// for free(), p may be NULL.
+always_inline void free_sized(void* p, size_t size) {
+  if (UNLIKELY(p == NULL)) {
+    return;
+  }
+  const int32_t sc = SizeToClass(size);
+  if (UNLIKELY(sc == 0)) {
+    // Size 0 or large object.
+    free(p);
+    return;
+  }
+  ScallocAssert(object_space.Contains(p));
+  ab_scheduler.GetAB().Free(p, sc);
+}
+
+
+// Sized deallocation for objects from aligned allocation: size and alignment
+// have to match the ones requested when allocating p.
+always_inline void free_aligned_sized(void* p, size_t alignment, size_t size) {
+  if (alignment <= kMinAlignment) {
+    free_sized(p, size);
+    return;
+  }
+  if (UNLIKELY(p == NULL)) {
+    return;
+  }
+  const int32_t sc = AlignedSizeToClass(size, alignment);
+  if (UNLIKELY(sc == 0)) {
+    free(p);
+    return;
+  }
+  ScallocAssert(object_space.Contains(p));
+  ab_scheduler.GetAB().Free(p, sc);
+}
+
+
 always_inline void* calloc(size_t nmemb, size_t size) {
   LOG(kTrace, "calloc: size: %lu", size);
   const size_t malloc_size = nmemb * size;
   if ((size != 0) && (malloc_size / size) != nmemb) {
     return NULL;
   }
-  void* result = malloc(malloc_size);  // malloc() sets errno
-  if (result != NULL) {
-    memset(result, 0, malloc_size);
-  }
-  return result;
+  // Only clears memory that is not known to be zero. Sets errno.
+  return ab_scheduler.GetAB().AllocateZeroed(malloc_size);
 }
 
 
@@ -74,35 +117,67 @@ always_inline void* realloc(void* ptr, size_t size) {
   if (UNLIKELY(ptr == NULL)) {
     return malloc(size);
   }
+  if (UNLIKELY(size == 0)) {
+    return ptr;
+  }
   void* new_obj = NULL;
+  size_t old_size;
+  // Objects are only kept in place if the new size maps to the same kind of
+  // block (size class or large object), since sized deallocation derives the
+  // size class from the requested size.
   if (LIKELY(object_space.Contains(ptr))) {
     Span* s = Span::FromObject(ptr);
-    const size_t old_size = ClassToSize[s->size_class()];
-    if (old_size >= size) {
+    const int32_t sc = s->size_class();
+    if (SizeToClass(size) == sc) {
       return ptr;
     }
-    new_obj = malloc(size);
-    if (new_obj == nullptr) return nullptr;
-    memmove(new_obj, ptr, old_size);
-    free(ptr);
+    old_size = ClassToSize[sc];
+    // Growing medium objects take their pages along into the large object.
+    if ((size > kMaxMediumSize) && (old_size >= LargeObject::kMinMoveSize)) {
+      new_obj = LargeObject::AllocateFromPages(ptr, old_size, size);
+      if (new_obj != nullptr) {
+        free(ptr);
+        return new_obj;
+      }
+    }
   } else {
-    const size_t old_size = LargeObject::PayloadSize(ptr);
-    if (old_size >= size) {
-      return ptr;
+    // Large objects are resized using the virtual memory system.
+    if (size > kMaxMediumSize) {
+      new_obj = LargeObject::Reallocate(ptr, size);
+      if (new_obj != nullptr) {
+        return new_obj;
+      }
     }
-    new_obj = malloc(size);
-    if (new_obj == nullptr) return nullptr;
-    memmove(new_obj, ptr, old_size);
-    free(ptr);
+    old_size = LargeObject::PayloadSize(ptr);
   }
+  new_obj = malloc(size);
+  if (new_obj == nullptr) return nullptr;
+  memmove(new_obj, ptr, (old_size < size) ? old_size : size);
+  free(ptr);
   return new_obj;
 }
 
 
+// Aligned objects are served from the smallest size class whose blocks are all
+// naturally aligned, or as large objects. alignment must be a power of two.
+always_inline void* aligned_malloc(size_t alignment, size_t size) {
+  if (alignment <= kMinAlignment) {
+    return malloc(size);
+  }
+  const int32_t sc = AlignedSizeToClass(size, alignment);
+  if (sc != 0) {
+    return malloc(ClassToSize[sc]);
+  }
+  return LargeObject::AllocateAligned(size, alignment);
+}
+
+
 always_inline int posix_memalign(void** ptr, size_t align, size_t size) {
   LOG(kTrace, "posix memalign: size: %lu", size);
-  if (seen_memalign == 0) {
-    seen_memalign = 1;
+  if (UNLIKELY((align == 0) ||
+               ((align & (align - 1)) != 0) ||
+               ((align % sizeof(void*)) != 0))) {
+    return EINVAL;
   }
 
   // Return free-able pointer for size 0.
@@ -111,41 +186,37 @@ always_inline int posix_memalign(void** ptr, size_t align, size_t size) {
     return 0;
   }
 
-  const size_t size_needed = align + size;
-
-  // TODO: check align for power of 2
-  // TODO: check size_needed for overflow
-
-  uintptr_t start = reinterpret_cast<uintptr_t>(malloc(size_needed));
-  if (UNLIKELY(start == 0)) {
+  void* p = aligned_malloc(align, size);
+  if (UNLIKELY(p == NULL)) {
     return ENOMEM;
   }
-
-  uintptr_t new_start = start + align - (start % align);
-  if (new_start != start) {
-    // We add a magicnumber to force recalculation of free() address. This is
-    // valid because we only transition into a slow path but handle the
-    // free still correct.
-    *(reinterpret_cast<uint32_t*>(new_start - sizeof(uint32_t))) = 0xAAAAAAAA;
-  }
-  *ptr = reinterpret_cast<void*>(new_start);
+  *ptr = p;
   return 0;
 }
 
 
 always_inline void* memalign(size_t __alignment, size_t __size) {
-  void* mem;
-  if (posix_memalign(&mem, __alignment, __size)) {
+  // Unlike posix_memalign(), memalign() accepts any alignment and rounds it up
+  // to the next power of two.
+  size_t alignment = kMinAlignment;
+  while ((alignment < __alignment) && (alignment != 0)) {
+    alignment <<= 1;
+  }
+  if (UNLIKELY(alignment == 0)) {
+    errno = EINVAL;
+    return NULL;
+  }
+  if (UNLIKELY(__size == 0)) {
     return NULL;
   }
-  return mem;
+  return aligned_malloc(alignment, __size);
 }
 
 
 always_inline void* aligned_alloc(size_t alignment, size_t size) {
   // The function aligned_alloc() is the same as memalign(), except for the
   // added restriction that size should be a multiple of alignment.
-  if (size % alignment != 0) {
+  if ((alignment == 0) || (size % alignment != 0)) {
     errno = EINVAL;
     return NULL;
   }
@@ -164,10 +235,42 @@ always_inline void* pvalloc(size_t __size) {
 
 
 inline void malloc_stats(void) {
+  statistics.Print();
 }
 
 
+#ifdef SCALLOC_HAVE_MALLINFO2
+// Small and medium objects are reported as the main arena, large objects as
+// mmapped regions.
+inline struct mallinfo2 mallinfo2(void) {
+  struct scalloc_stats stats;
+  statistics.Collect(&stats);
+  struct mallinfo2 info;
+  memset(&info, 0, sizeof(info));
+  info.arena = stats.span_bytes;
+  info.hblks = stats.large_objects;
+  info.hblkhd = stats.large_bytes;
+  info.uordblks = stats.live_bytes;
+  info.fordblks = (stats.span_bytes > stats.live_bytes) ?
+      (stats.span_bytes - stats.live_bytes) : 0;
+  return info;
+}
+#endif  // SCALLOC_HAVE_MALLINFO2
+
+
 inline int mallopt(int cmd, int value) {
+  switch (cmd) {
+    case M_SCALLOC_SCAVENGER_DECAY:
+      return scavenger.SetDecay(value);
+    case M_SCALLOC_SCAVENGER_RATE:
+      return scavenger.SetRate(value);
+    case M_SCALLOC_PURGE:
+      return span_pool.SetPurgeStrategy(value);
+#ifdef SCALLOC_HEAP_PROFILER
+    case M_SCALLOC_PROFILE_SAMPLE_RATE:
+      return heap_profiler.SetSampleRate(value);
+#endif  // SCALLOC_HEAP_PROFILER
+  }
   return 0;
 }
 
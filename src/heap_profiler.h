@@ -0,0 +1,392 @@
+// Copyright (c) 2015, the scalloc project authors.  All rights reserved.
+// Please see the AUTHORS file for details.  Use of this source code is governed
+// by a BSD license that can be found in the LICENSE file.
+
+#ifndef SCALLOC_HEAP_PROFILER_H_
+#define SCALLOC_HEAP_PROFILER_H_
+
+#include <errno.h>
+#include <fcntl.h>
+#include <math.h>
+#include <pthread.h>
+#include <semaphore.h>
+#include <signal.h>
+#include <stdarg.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <atomic>
+
+#include "arena.h"
+#include "globals.h"
+#include "lock.h"
+#include "log.h"
+#include "stack.h"
+#include "utils.h"
+
+// mallopt() parameter: Average number of bytes allocated between two samples
+// of the heap profiler. 0 disables sampling.
+#define M_SCALLOC_PROFILE_SAMPLE_RATE (-1004)
+
+#ifdef SCALLOC_HEAP_PROFILER
+
+namespace scalloc {
+
+// Sampling heap profiler. Cores count down the bytes they allocate and take a
+// sample whenever the countdown expires, with sampling intervals drawn from an
+// exponential distribution. A sample records the stack trace of the allocation
+// and lives in a hash table keyed by the object until the object is freed.
+//
+// Profiles are written in the legacy heap profile format of gperftools, which
+// pprof scales from samples to the estimated total.
+//
+// Stack traces are taken by walking frame pointers, i.e., code compiled
+// without frame pointers truncates traces.
+class HeapProfiler {
+ public:
+  // Globally constructed, hence we use staged construction.
+  always_inline HeapProfiler() {}
+  always_inline ~HeapProfiler() {}
+
+  // Reads the sample rate from the environment variable
+  // SCALLOC_PROFILE_SAMPLE_RATE. Requires the core space to be initialized.
+  always_inline void Init();
+
+  // Dumps a profile to <SCALLOC_PROFILE_PREFIX>.<pid>.<n>.heap whenever the
+  // process receives the signal SCALLOC_PROFILE_SIGNAL. Starts a thread, hence
+  // has to be called once the allocator is up.
+  always_inline void InstallSignalHandler();
+
+  // mallopt() style setter. Returns 1 on success and 0 on error. Cores pick up
+  // a new rate after finishing their current sampling interval.
+  always_inline int SetSampleRate(int rate);
+
+  // Returns the number of bytes to allocate before taking the next sample.
+  always_inline int64_t NextSampleInterval();
+
+  // Records a sample for the object p of the given requested size. Returns
+  // false if sampling is disabled or there is no memory for the sample.
+  always_inline bool Record(void* p, size_t size);
+
+  // Removes the sample of p. Returns false if p has not been sampled.
+  always_inline bool Remove(void* p);
+
+  // Writes all live samples to path. Returns 0 on success and an errno value
+  // otherwise.
+  inline int Dump(const char* path);
+
+ private:
+  static const int32_t kMaxStackDepth = 32;
+  static const int32_t kBucketShift = 16;
+  static const int32_t kBuckets = 1 << kBucketShift;
+  static const int32_t kLocks = 256;
+  // Interval used while sampling is disabled, after which cores check again.
+  static const int64_t kDisabledInterval = 1L << 30;
+  // Largest frame considered plausible when walking frame pointers.
+  static const uintptr_t kMaxFrameSize = 1 << 20;
+
+  struct Sample {
+    Sample* next;
+    void* ptr;
+    size_t size;
+    int32_t depth;
+    void* stack[kMaxStackDepth];
+  };
+
+  typedef SpinLock<64> Lock;
+
+  class Writer;
+
+  static void* RunDumper(void* arg);
+  static void SignalHandler(int signal);
+
+  static always_inline int32_t GetStackTrace(void** stack, int32_t max);
+
+  always_inline int32_t Bucket(void* p) {
+    return ((reinterpret_cast<uintptr_t>(p) >> 4) * 0x9E3779B97F4A7C15UL) >>
+           (64 - kBucketShift);
+  }
+  always_inline Lock& BucketLock(int32_t bucket) {
+    return locks_[bucket % kLocks];
+  }
+
+  std::atomic<int64_t> rate_;
+  std::atomic<uint64_t> dumps_;
+  const char* prefix_;
+  sem_t dump_requests_;
+
+  UNUSED uint8_t pad_[64 - ((sizeof(rate_) +
+                             sizeof(dumps_) +
+                             sizeof(prefix_) +
+                             sizeof(dump_requests_)) % 64)];
+
+  // Samples that are not in use.
+  Stack<64> free_samples_;
+
+  Lock locks_[kLocks];
+  Sample* buckets_[kBuckets];
+};
+
+
+void HeapProfiler::Init() {
+  rate_ = SCALLOC_PROFILE_SAMPLE_RATE;
+  dumps_ = 0;
+  const char* env = getenv("SCALLOC_PROFILE_SAMPLE_RATE");
+  if (env != nullptr) {
+    SetSampleRate(atoi(env));
+  }
+}
+
+
+void HeapProfiler::InstallSignalHandler() {
+  const char* env = getenv("SCALLOC_PROFILE_SIGNAL");
+  if (env == nullptr) {
+    return;
+  }
+  const int signal = atoi(env);
+  prefix_ = getenv("SCALLOC_PROFILE_PREFIX");
+  if (prefix_ == nullptr) {
+    prefix_ = "scalloc";
+  }
+  if (sem_init(&dump_requests_, 0, 0) != 0) {
+    LOG(kWarning, "heap profiler: sem_init failed");
+    return;
+  }
+  pthread_t thread;
+  if (pthread_create(&thread, nullptr, RunDumper, this) != 0) {
+    LOG(kWarning, "heap profiler: failed to start dumper");
+    return;
+  }
+  pthread_detach(thread);
+  struct sigaction action;
+  memset(&action, 0, sizeof(action));
+  action.sa_handler = SignalHandler;
+  action.sa_flags = SA_RESTART;
+  sigemptyset(&action.sa_mask);
+  if (sigaction(signal, &action, nullptr) != 0) {
+    LOG(kWarning, "heap profiler: cannot install handler for signal %d",
+        signal);
+  }
+}
+
+
+int HeapProfiler::SetSampleRate(int rate) {
+  if (rate < 0) {
+    return 0;
+  }
+  rate_ = rate;
+  return 1;
+}
+
+
+int64_t HeapProfiler::NextSampleInterval() {
+  const int64_t rate = rate_.load(std::memory_order_relaxed);
+  if (rate == 0) {
+    return kDisabledInterval;
+  }
+  // Exponentially distributed with mean rate, using a hashed time stamp as
+  // uniform random number in (0, 1].
+  uint64_t x = rdtsc();
+  x = (x ^ (x >> 30)) * 0xBF58476D1CE4E5B9UL;
+  x = (x ^ (x >> 27)) * 0x94D049BB133111EBUL;
+  x = x ^ (x >> 31);
+  const double u = (static_cast<double>(x >> 11) + 1.0) / 9007199254740992.0;
+  return static_cast<int64_t>(-log(u) * rate) + 1;
+}
+
+
+int32_t HeapProfiler::GetStackTrace(void** stack, int32_t max) {
+  void** fp = reinterpret_cast<void**>(__builtin_frame_address(0));
+  int32_t depth = 0;
+  while ((fp != nullptr) && (depth < max)) {
+    void* ret = fp[1];
+    if (ret == nullptr) {
+      break;
+    }
+    stack[depth++] = ret;
+    void** next = reinterpret_cast<void**>(fp[0]);
+    // Stacks grow downwards. Anything else is not a frame.
+    if ((next <= fp) ||
+        ((reinterpret_cast<uintptr_t>(next) -
+          reinterpret_cast<uintptr_t>(fp)) > kMaxFrameSize) ||
+        ((reinterpret_cast<uintptr_t>(next) % sizeof(void*)) != 0)) {
+      break;
+    }
+    fp = next;
+  }
+  return depth;
+}
+
+
+bool HeapProfiler::Record(void* p, size_t size) {
+  if (rate_.load(std::memory_order_relaxed) == 0) {
+    return false;
+  }
+  Sample* sample = reinterpret_cast<Sample*>(free_samples_.Pop());
+  if (sample == nullptr) {
+    sample = reinterpret_cast<Sample*>(core_space.Allocate(sizeof(Sample)));
+    if (sample == nullptr) {
+      return false;
+    }
+  }
+  sample->ptr = p;
+  sample->size = size;
+  sample->depth = GetStackTrace(sample->stack, kMaxStackDepth);
+  // Objects that got reused without being freed through a core, e.g., from
+  // per-CPU caches, may still have a stale sample, which is replaced.
+  Remove(p);
+  const int32_t bucket = Bucket(p);
+  Lock::Guard guard(BucketLock(bucket));
+  sample->next = buckets_[bucket];
+  buckets_[bucket] = sample;
+  return true;
+}
+
+
+bool HeapProfiler::Remove(void* p) {
+  const int32_t bucket = Bucket(p);
+  Sample* sample = nullptr;
+  {
+    Lock::Guard guard(BucketLock(bucket));
+    Sample** prev = &buckets_[bucket];
+    while ((*prev != nullptr) && ((*prev)->ptr != p)) {
+      prev = &(*prev)->next;
+    }
+    sample = *prev;
+    if (sample != nullptr) {
+      *prev = sample->next;
+    }
+  }
+  if (sample == nullptr) {
+    return false;
+  }
+  free_samples_.Push(sample);
+  return true;
+}
+
+
+// Buffered writing using system calls only, so that dumping does not allocate.
+class HeapProfiler::Writer {
+ public:
+  always_inline explicit Writer(int fd) : fd_(fd), len_(0), error_(0) {}
+
+  inline void Printf(const char* format, ...)
+      __attribute__((format(printf, 2, 3))) {
+    if (len_ > static_cast<int32_t>(sizeof(buf_)) - kMaxLineLength) {
+      Flush();
+    }
+    va_list args;
+    va_start(args, format);
+    const int n = vsnprintf(&buf_[len_], sizeof(buf_) - len_, format, args);
+    va_end(args);
+    if (n > 0) {
+      len_ += (n < static_cast<int>(sizeof(buf_)) - len_) ?
+          n : static_cast<int>(sizeof(buf_)) - len_ - 1;
+    }
+  }
+
+  inline void Write(const char* data, ssize_t len) {
+    Flush();
+    if (write(fd_, data, len) != len) {
+      error_ = errno;
+    }
+  }
+
+  inline void Flush() {
+    if ((len_ > 0) && (write(fd_, buf_, len_) != len_)) {
+      error_ = errno;
+    }
+    len_ = 0;
+  }
+
+  always_inline int error() { return error_; }
+
+ private:
+  static const int32_t kMaxLineLength = 512;
+
+  int fd_;
+  int32_t len_;
+  int error_;
+  char buf_[4096];
+};
+
+
+int HeapProfiler::Dump(const char* path) {
+  const int fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+  if (fd < 0) {
+    return errno;
+  }
+  uint64_t objects = 0;
+  uint64_t bytes = 0;
+  for (int32_t i = 0; i < kBuckets; i++) {
+    Lock::Guard guard(BucketLock(i));
+    for (Sample* s = buckets_[i]; s != nullptr; s = s->next) {
+      objects++;
+      bytes += s->size;
+    }
+  }
+
+  Writer writer(fd);
+  writer.Printf("heap profile: %lu: %lu [%lu: %lu] @ heap_v2/%ld\n",
+                objects, bytes, objects, bytes, rate_.load());
+  for (int32_t i = 0; i < kBuckets; i++) {
+    Lock::Guard guard(BucketLock(i));
+    for (Sample* s = buckets_[i]; s != nullptr; s = s->next) {
+      writer.Printf("1: %lu [1: %lu] @", s->size, s->size);
+      for (int32_t j = 0; j < s->depth; j++) {
+        writer.Printf(" %p", s->stack[j]);
+      }
+      writer.Printf("\n");
+    }
+  }
+
+  // Lets pprof symbolize the profile.
+  writer.Printf("\nMAPPED_LIBRARIES:\n");
+  const int maps = open("/proc/self/maps", O_RDONLY);
+  if (maps >= 0) {
+    char buf[4096];
+    ssize_t n;
+    while ((n = read(maps, buf, sizeof(buf))) > 0) {
+      writer.Write(buf, n);
+    }
+    close(maps);
+  }
+  writer.Flush();
+  close(fd);
+  return writer.error();
+}
+
+
+void HeapProfiler::SignalHandler(int signal) {
+  const int saved_errno = errno;
+  sem_post(&heap_profiler.dump_requests_);
+  errno = saved_errno;
+}
+
+
+void* HeapProfiler::RunDumper(void* arg) {
+  HeapProfiler* self = reinterpret_cast<HeapProfiler*>(arg);
+  char path[512];
+  while (true) {
+    if (sem_wait(&self->dump_requests_) != 0) {
+      continue;
+    }
+    snprintf(path, sizeof(path), "%s.%d.%lu.heap",
+             self->prefix_, getpid(), self->dumps_.fetch_add(1));
+    const int error = self->Dump(path);
+    if (error != 0) {
+      LOG(kWarning, "heap profiler: writing %s failed: %s",
+          path, strerror(error));
+    }
+  }
+  return nullptr;
+}
+
+}  // namespace scalloc
+
+#endif  // SCALLOC_HEAP_PROFILER
+
+#endif  // SCALLOC_HEAP_PROFILER_H_
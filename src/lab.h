@@ -6,7 +6,10 @@
 #define SCALLOC_LAB_H_
 
 #include <pthread.h>
+#include <sched.h>
+#include <stddef.h>
 #include <stdint.h>
+#include <string.h>
 #include <unistd.h>
 
 #include <atomic>
@@ -15,6 +18,9 @@
 #include "core_id.h"
 #include "globals.h"
 #include "log.h"
+#if SCALLOC_LAB_MODEL == SCALLOC_LAB_MODEL_PERCPU
+#include "platform/rseq.h"
+#endif  // SCALLOC_LAB_MODEL_PERCPU
 
 namespace scalloc {
 
@@ -116,7 +122,10 @@ void ThreadLocalAllocationBuffer::Init() {
 Core* ThreadLocalAllocationBuffer::FindFreeAB() {
   Core* ab = reinterpret_cast<Core*>(free_abs_.Pop());
   if (ab == NULL) {
-    ab =  new(core_space.Allocate(sizeof(Core))) Core();
+    void* p = core_space.Allocate(sizeof(Core));
+    if (p != nullptr) {
+      ab = new(p) Core();
+    }
   }
   return ab;
 }
@@ -135,7 +144,7 @@ void ThreadLocalAllocationBuffer::GetMeALAB() {
   if (LIKELY(ab == NULL)) {
     ab = FindFreeAB();
     if (UNLIKELY(ab == NULL)) {
-      Fatal("reached maximum number of threads.");
+      Fatal("out of memory for thread-local allocation buffers.");
     }
     ab->Init(core_id(ab, thread_ids_.fetch_add(1) + 1));
     SetTLS(ab);
@@ -158,21 +167,30 @@ class RoundRobinAllocationBuffer : public TLSBase<GuardedCore> {
 
   always_inline void Init();
   always_inline GuardedCore& GetAB();
+  always_inline void GetMeALAB() {}
 
  private:
   static inline void ThreadDestructor(void* lab);
 
-  static GuardedCore allocation_buffers_[kMaxThreads];
+  GuardedCore* allocation_buffers_;
   std::atomic<uint_fast64_t> thread_counter_;
 };
 
 
-GuardedCore RoundRobinAllocationBuffer::allocation_buffers_[kMaxThreads];
-
-
 void RoundRobinAllocationBuffer::Init() {
   TLSBase<scalloc::GuardedCore>::Init(ThreadDestructor);
   thread_counter_ = 0;
+  const int32_t num_cores = CpusOnline();
+  allocation_buffers_ = reinterpret_cast<GuardedCore*>(
+      core_space.Allocate(sizeof(GuardedCore) * num_cores));
+  if (allocation_buffers_ == nullptr) {
+    Fatal("out of memory for allocation buffers.");
+  }
+  for (int32_t i = 0; i < num_cores; i++) {
+    GuardedCore* ab = new(&allocation_buffers_[i]) GuardedCore();
+    ab->Init(core_id(ab, i + 1));
+    span_pool.AnnounceNewThread();
+  }
 }
 
 
@@ -194,6 +212,210 @@ GuardedCore& RoundRobinAllocationBuffer::GetAB() {
   return *ab;
 }
 
+
+#if SCALLOC_LAB_MODEL == SCALLOC_LAB_MODEL_PERCPU
+// Binds cores to CPUs instead of threads. Small objects are served from
+// per-CPU caches that are accessed using restartable sequences, i.e., without
+// any lock or atomic operation. Everything else goes to the CPU's core, which
+// is shared by all threads running on that CPU.
+//
+// The caches are only ever modified by restartable sequences on their own CPU,
+// so a thread that gets preempted while holding a core's lock does not block
+// other threads' fast paths.
+class PerCpuAllocationBuffer {
+ public:
+  // Globally constructed, hence we use staged construction.
+  always_inline PerCpuAllocationBuffer() {}
+  always_inline ~PerCpuAllocationBuffer() {}
+
+  always_inline void Init();
+  always_inline PerCpuAllocationBuffer& GetAB() { return *this; }
+  always_inline void GetMeALAB();
+
+  always_inline void* Allocate(size_t size);
+  always_inline void* AllocateZeroed(size_t size);
+  always_inline void Free(void* p);
+  always_inline void Free(void* p, int32_t size_class);
+
+ private:
+  // Objects of small size classes cached for a CPU. Objects may come from any
+  // span.
+  struct CpuCache {
+    uint32_t len[kFineClasses];
+    void* objects[kFineClasses][kObjectCacheSize];
+  } cache_aligned;
+
+  // Number of objects moved between a cache and its core at once.
+  static const int32_t kTransferSize = kObjectCacheSize / 2;
+
+  always_inline RseqArea* rseq();
+  always_inline LockedCore& CurrentCore();
+  always_inline void* CachePop(RseqArea* rs, int32_t sc);
+  always_inline bool CachePush(RseqArea* rs, int32_t sc, void* p);
+  always_inline void* Refill(RseqArea* rs, int32_t sc);
+  always_inline void Drain(RseqArea* rs, int32_t sc, void* p);
+
+  static TLS_ATTRIBUTE RseqArea* rseq_;
+  static TLS_ATTRIBUTE bool registered_;
+
+  int32_t cpus_;
+  CpuCache* caches_;
+  LockedCore* cores_;
+};
+
+
+TLS_ATTRIBUTE RseqArea* PerCpuAllocationBuffer::rseq_;
+TLS_ATTRIBUTE bool PerCpuAllocationBuffer::registered_;
+
+
+void PerCpuAllocationBuffer::Init() {
+  cpus_ = static_cast<int32_t>(sysconf(_SC_NPROCESSORS_CONF));
+  if (cpus_ < CpusOnline()) {
+    cpus_ = CpusOnline();
+  }
+  caches_ = reinterpret_cast<CpuCache*>(
+      SystemMmapFail(sizeof(CpuCache) * cpus_));
+  cores_ = reinterpret_cast<LockedCore*>(
+      SystemMmapFail(sizeof(LockedCore) * cpus_));
+  for (int32_t i = 0; i < cpus_; i++) {
+    LockedCore* core = new(&cores_[i]) LockedCore();
+    core->Init(core_id(core, i + 1));
+    span_pool.AnnounceNewThread();
+  }
+}
+
+
+void PerCpuAllocationBuffer::GetMeALAB() {
+  if (!registered_) {
+    registered_ = true;
+    rseq_ = RseqRegister();
+    if (rseq_ == nullptr) {
+      LOG(kWarning, "rseq unavailable, falling back to locked cores");
+    }
+  }
+}
+
+
+// The calling thread's rseq area, or nullptr if rseq is not available.
+RseqArea* PerCpuAllocationBuffer::rseq() {
+  RseqArea* rs = rseq_;
+  if (UNLIKELY(rs == nullptr) && !registered_) {
+    GetMeALAB();
+    rs = rseq_;
+  }
+  return rs;
+}
+
+
+LockedCore& PerCpuAllocationBuffer::CurrentCore() {
+  int32_t cpu = (rseq_ != nullptr) ? rseq_->cpu_id : sched_getcpu();
+  if (UNLIKELY((cpu < 0) || (cpu >= cpus_))) {
+    cpu = 0;
+  }
+  return cores_[cpu];
+}
+
+
+void* PerCpuAllocationBuffer::CachePop(RseqArea* rs, int32_t sc) {
+  return RseqPop(rs,
+                 reinterpret_cast<uintptr_t>(caches_),
+                 sizeof(CpuCache),
+                 offsetof(CpuCache, len) + sc * sizeof(uint32_t),
+                 offsetof(CpuCache, objects) + sc * sizeof(caches_->objects[0]));
+}
+
+
+bool PerCpuAllocationBuffer::CachePush(RseqArea* rs, int32_t sc, void* p) {
+  return RseqPush(rs,
+                  reinterpret_cast<uintptr_t>(caches_),
+                  sizeof(CpuCache),
+                  offsetof(CpuCache, len) + sc * sizeof(uint32_t),
+                  offsetof(CpuCache, objects) + sc * sizeof(caches_->objects[0]),
+                  kObjectCacheSize,
+                  p);
+}
+
+
+void* PerCpuAllocationBuffer::Refill(RseqArea* rs, int32_t sc) {
+  void* objs[kTransferSize];
+  const int32_t n = CurrentCore().AllocateBatch(
+      ClassToSize[sc], objs, kTransferSize);
+  if (UNLIKELY(n == 0)) {
+    return nullptr;
+  }
+  int32_t i = 1;
+  while ((i < n) && CachePush(rs, sc, objs[i])) {
+    i++;
+  }
+  if (i < n) {
+    // Other threads on this CPU filled up the cache in the meantime.
+    CurrentCore().FreeBatch(&objs[i], n - i);
+  }
+  return objs[0];
+}
+
+
+void PerCpuAllocationBuffer::Drain(RseqArea* rs, int32_t sc, void* p) {
+  void* objs[kTransferSize + 1];
+  int32_t n = 0;
+  while ((n < kTransferSize) && ((objs[n] = CachePop(rs, sc)) != nullptr)) {
+    n++;
+  }
+  objs[n++] = p;
+  CurrentCore().FreeBatch(objs, n);
+}
+
+
+void* PerCpuAllocationBuffer::Allocate(size_t size) {
+  const size_t sc = SizeToClass(size);
+  // Size class 0 (size 0 and large objects) is never cached.
+  if (LIKELY((sc - 1) < (kFineClasses - 1))) {
+    RseqArea* rs = rseq();
+    if (LIKELY(rs != nullptr)) {
+      void* p = CachePop(rs, sc);
+      if (LIKELY(p != nullptr)) {
+        return p;
+      }
+      return Refill(rs, sc);
+    }
+  }
+  return CurrentCore().Allocate(size);
+}
+
+
+void* PerCpuAllocationBuffer::AllocateZeroed(size_t size) {
+  const size_t sc = SizeToClass(size);
+  if ((sc - 1) < (kFineClasses - 1)) {
+    void* p = Allocate(size);
+    if (p != nullptr) {
+      memset(p, 0, size);
+    }
+    return p;
+  }
+  return CurrentCore().AllocateZeroed(size);
+}
+
+
+void PerCpuAllocationBuffer::Free(void* p) {
+  Free(p, Span::FromObject(p)->size_class());
+}
+
+
+void PerCpuAllocationBuffer::Free(void* p, int32_t size_class) {
+  if (LIKELY(size_class < static_cast<int32_t>(kFineClasses))) {
+    RseqArea* rs = rseq();
+    if (LIKELY(rs != nullptr)) {
+      if (LIKELY(CachePush(rs, size_class, p))) {
+        return;
+      }
+      Drain(rs, size_class, p);
+      return;
+    }
+  }
+  CurrentCore().Free(p, size_class);
+}
+#endif  // SCALLOC_LAB_MODEL_PERCPU
+
 }  // namespace scalloc
 
 #endif  // SCALLOC_LAB_H_
@@ -7,9 +7,13 @@
 
 #include <stdint.h>
 
+#include <atomic>
 #include <new>
 
 #include "globals.h"
+#include "heap_profiler.h"
+#include "large_object_cache.h"
+#include "stats.h"
 #include "utils.h"
 
 namespace scalloc {
@@ -17,35 +21,63 @@ namespace scalloc {
 class LargeObject {
  public:
   static always_inline void* Allocate(size_t size);
+  static always_inline void* Allocate(size_t size, bool* zeroed);
+  static always_inline void* AllocateAligned(size_t size, size_t alignment);
+  static always_inline void* AllocateFromPages(void* p, size_t len,
+                                               size_t size);
+  static always_inline void* Reallocate(void* p, size_t size);
   static always_inline void Free(void* p);
   static always_inline size_t PayloadSize(void* p);
+  // Marks p as sampled by the heap profiler.
+  static always_inline void MarkSampled(void* p);
+
+  // Smallest block that is moved instead of copied when growing into a large
+  // object.
+  static const size_t kMinMoveSize = 256 * kKilo;
 
  private:
   static const uint64_t kMagic = 0xAAAAAAAAAAAAAAAA;
 
+  // Live objects created by AllocateFromPages().
+  static std::atomic<int32_t> nr_moved_;
+
   static always_inline LargeObject* FromMutatorPtr(void* p);
 
-  always_inline explicit LargeObject(size_t size);
+  always_inline LargeObject(size_t size, size_t offset);
   always_inline void* ObjectStart();
+  always_inline void* MappingStart();
   always_inline bool Validate();
 
-  always_inline size_t payload_size() { return actual_size_ - sizeof(*this); }
+  always_inline size_t payload_size() {
+    return actual_size_ - offset_ - sizeof(*this);
+  }
   always_inline size_t actual_size() { return actual_size_; }
 
+  // Size of the whole mapping.
   size_t actual_size_;
+  // Offset of the header from the start of the mapping. Only non-zero for
+  // aligned objects.
+  size_t offset_;
   uint64_t magic_;
+  uint32_t sampled_;
+  // Whether the object took over the pages of another block, i.e., consists
+  // of more than one mapping.
+  uint32_t moved_;
 };
 
 
+std::atomic<int32_t> LargeObject::nr_moved_;
+
+
 bool LargeObject::Validate() {
   return magic_ == kMagic;
 }
 
 
 LargeObject* LargeObject::FromMutatorPtr(void* p) {
-  // LargeObject is always allocated using mmap, hence it is page aligned.
+  // The header always immediately precedes the object.
   LargeObject* obj = reinterpret_cast<LargeObject*>(
-      reinterpret_cast<intptr_t>(p) & kPageNrMask);
+      reinterpret_cast<intptr_t>(p) - sizeof(LargeObject));
   if (!obj->Validate()) {
     Fatal("invalid large object: %p", p);
   }
@@ -54,8 +86,20 @@ LargeObject* LargeObject::FromMutatorPtr(void* p) {
 
 
 void* LargeObject::Allocate(size_t size) {
-  const size_t actual_size = PadSize(size + sizeof(LargeObject), kPageSize);
-  LargeObject* obj = new(SystemMmapFail(actual_size)) LargeObject(actual_size);
+  bool zeroed;
+  return Allocate(size, &zeroed);
+}
+
+
+// Reports whether the object is known to be zero, i.e., freshly mapped.
+void* LargeObject::Allocate(size_t size, bool* zeroed) {
+  size_t actual_size = PadSize(size + sizeof(LargeObject), kPageSize);
+  void* mapping = large_object_cache.Allocate(&actual_size);
+  *zeroed = (mapping == nullptr);
+  if (mapping == nullptr) {
+    mapping = SystemMmapFail(actual_size);
+  }
+  LargeObject* obj = new(mapping) LargeObject(actual_size, 0);
 #ifdef DEBUG
   // Force the check by going through the mutator pointer.
   obj = LargeObject::FromMutatorPtr(obj->ObjectStart());
@@ -64,23 +108,189 @@ void* LargeObject::Allocate(size_t size) {
 }
 
 
+// Over-allocates by alignment and returns whole pages before the header and
+// after the object to the system.
+void* LargeObject::AllocateAligned(size_t size, size_t alignment) {
+  ScallocAssert((alignment & (alignment - 1)) == 0);
+  if (alignment <= kMinAlignment) {
+    return Allocate(size);
+  }
+  const size_t mapped_size =
+      PadSize(size + sizeof(LargeObject) + alignment, kPageSize);
+  const uintptr_t mapping =
+      reinterpret_cast<uintptr_t>(SystemMmapFail(mapped_size));
+  const uintptr_t start =
+      PadSize(mapping + sizeof(LargeObject), alignment);
+  const uintptr_t header = start - sizeof(LargeObject);
+  const uintptr_t first = header & kPageNrMask;
+  const uintptr_t end = PadSize(start + size, kPageSize);
+  if ((first > mapping) &&
+      (munmap(reinterpret_cast<void*>(mapping), first - mapping) != 0)) {
+    Fatal("munmap failed");
+  }
+  if (((mapping + mapped_size) > end) &&
+      (munmap(reinterpret_cast<void*>(end), mapping + mapped_size - end) != 0)) {
+    Fatal("munmap failed");
+  }
+  LargeObject* obj = new(reinterpret_cast<void*>(header))
+      LargeObject(end - first, header - first);
+#ifdef DEBUG
+  obj = LargeObject::FromMutatorPtr(obj->ObjectStart());
+#endif  // DEBUG
+  ScallocAssert((reinterpret_cast<uintptr_t>(obj->ObjectStart()) %
+                 alignment) == 0);
+  return obj->ObjectStart();
+}
+
+
+// Allocates a large object of size bytes, taking over len bytes from the page
+// aligned block p by moving its pages instead of copying. p itself stays
+// mapped (but zeroed). Returns nullptr if the pages could not be moved.
+//
+// The moved pages never merge with the mapping around them, so such an object
+// splits into several mappings. Their number is bounded by only keeping up to
+// kLargeObjectMaxMoved of these objects alive.
+void* LargeObject::AllocateFromPages(void* p, size_t len, size_t size) {
+#if defined(MREMAP_MAYMOVE) && defined(MREMAP_FIXED) && \
+    defined(MREMAP_DONTUNMAP)
+  ScallocAssert((reinterpret_cast<uintptr_t>(p) % kPageSize) == 0);
+  ScallocAssert((len % kPageSize) == 0);
+  ScallocAssert(len <= size);
+  if (nr_moved_.fetch_add(1) >= kLargeObjectMaxMoved) {
+    nr_moved_.fetch_sub(1);
+    return nullptr;
+  }
+  // The object starts on the second page, with the header at the end of the
+  // first one.
+  const size_t actual_size = kPageSize + PadSize(size, kPageSize);
+  void* mapping = SystemMmap(actual_size);
+  if (mapping == nullptr) {
+    nr_moved_.fetch_sub(1);
+    return nullptr;
+  }
+  void* start = reinterpret_cast<void*>(
+      reinterpret_cast<uintptr_t>(mapping) + kPageSize);
+  if (mremap(p, len, len, MREMAP_MAYMOVE | MREMAP_FIXED | MREMAP_DONTUNMAP,
+             start) == MAP_FAILED) {
+    munmap(mapping, actual_size);
+    nr_moved_.fetch_sub(1);
+    return nullptr;
+  }
+  LargeObject* obj = new(reinterpret_cast<void*>(
+      reinterpret_cast<uintptr_t>(start) - sizeof(LargeObject)))
+      LargeObject(actual_size, kPageSize - sizeof(LargeObject));
+  obj->moved_ = 1;
+#ifdef DEBUG
+  obj = LargeObject::FromMutatorPtr(obj->ObjectStart());
+#endif  // DEBUG
+  return obj->ObjectStart();
+#else
+  return nullptr;
+#endif  // MREMAP_MAYMOVE && MREMAP_FIXED && MREMAP_DONTUNMAP
+}
+
+
+// Resizes a large object in place or by remapping its pages. Shrinking by less
+// than half keeps the mapping but returns the unused tail pages to the system.
+// Returns nullptr if the object could not be resized without copying.
+void* LargeObject::Reallocate(void* p, size_t size) {
+  LargeObject* obj = FromMutatorPtr(p);
+  const uintptr_t mapping = reinterpret_cast<uintptr_t>(obj->MappingStart());
+  const size_t actual_size = obj->actual_size();
+  const size_t offset = obj->offset_;
+  const size_t new_size =
+      PadSize(offset + sizeof(LargeObject) + size, kPageSize);
+
+  if (new_size <= actual_size) {
+    const size_t tail = actual_size - new_size;
+    if (tail == 0) {
+      return p;
+    }
+    if (new_size < (actual_size / 2)) {
+      if (munmap(reinterpret_cast<void*>(mapping + new_size), tail) != 0) {
+        Fatal("munmap failed");
+      }
+      obj->actual_size_ = new_size;
+      statistics.ResizeLargeObject(-static_cast<int64_t>(tail));
+#ifdef SCALLOC_MADVISE
+    } else {
+      madvise(reinterpret_cast<void*>(mapping + new_size), tail,
+              MADV_DONTNEED);
+#endif  // SCALLOC_MADVISE
+    }
+    return p;
+  }
+
+#ifdef MREMAP_MAYMOVE
+#ifdef SCALLOC_HEAP_PROFILER
+  // Samples are keyed by address, so moved objects lose their sample.
+  if (obj->sampled_ != 0) {
+    heap_profiler.Remove(p);
+    obj->sampled_ = 0;
+  }
+#endif  // SCALLOC_HEAP_PROFILER
+  void* new_mapping = mremap(reinterpret_cast<void*>(mapping), actual_size,
+                             new_size, MREMAP_MAYMOVE);
+  if (new_mapping == MAP_FAILED) {
+    return nullptr;
+  }
+  obj = reinterpret_cast<LargeObject*>(
+      reinterpret_cast<uintptr_t>(new_mapping) + offset);
+  obj->actual_size_ = new_size;
+  statistics.ResizeLargeObject(new_size - actual_size);
+  return obj->ObjectStart();
+#else
+  return nullptr;
+#endif  // MREMAP_MAYMOVE
+}
+
+
 void LargeObject::Free(void* p) {
   LargeObject* obj = FromMutatorPtr(p);
-  if (munmap(obj, obj->actual_size()) != 0) {
+  void* mapping = obj->MappingStart();
+  const size_t size = obj->actual_size();
+  statistics.RemoveLargeObject(size);
+#ifdef SCALLOC_HEAP_PROFILER
+  if (UNLIKELY(obj->sampled_ != 0)) {
+    heap_profiler.Remove(p);
+  }
+#endif  // SCALLOC_HEAP_PROFILER
+  if (obj->moved_ != 0) {
+    // Not cached, as reusing the mapping would keep it split.
+    nr_moved_.fetch_sub(1);
+  } else if (large_object_cache.Free(mapping, size)) {
+    return;
+  }
+  if (munmap(mapping, size) != 0) {
     Fatal("munmap failed");
   }
 }
 
 
+void LargeObject::MarkSampled(void* p) {
+  FromMutatorPtr(p)->sampled_ = 1;
+}
+
+
 size_t LargeObject::PayloadSize(void* p) {
   LargeObject* obj = FromMutatorPtr(p);
   return obj->payload_size();
 }
 
 
-LargeObject::LargeObject(size_t size)
+LargeObject::LargeObject(size_t size, size_t offset)
     : actual_size_(size)
-    , magic_(kMagic) {
+    , offset_(offset)
+    , magic_(kMagic)
+    , sampled_(0)
+    , moved_(0) {
+  statistics.AddLargeObject(size);
+}
+
+
+void* LargeObject::MappingStart() {
+  return reinterpret_cast<void*>(
+      reinterpret_cast<intptr_t>(this) - offset_);
 }
 
 
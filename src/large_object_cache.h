@@ -0,0 +1,268 @@
+// Copyright (c) 2015, the scalloc Project Authors.  All rights reserved.
+// Please see the AUTHORS file for details.  Use of this source code is governed
+// by a BSD license that can be found in the LICENSE file.
+
+#ifndef SCALLOC_LARGE_OBJECT_CACHE_H_
+#define SCALLOC_LARGE_OBJECT_CACHE_H_
+
+#include <pthread.h>
+#include <stdint.h>
+#include <sys/mman.h>
+
+#include <atomic>
+
+#include "globals.h"
+#include "lock.h"
+#include "log.h"
+#include "utils.h"
+
+namespace scalloc {
+
+// A cache of recently freed large object mappings that avoids an mmap/munmap
+// pair (and the involved TLB shootdowns) for every large object.
+//
+// Mappings are kept in global lists, bucketed by size with four buckets per
+// power of two. Fresh mappings are rounded up to their bucket's size so that
+// they can later be reused for any request of the same bucket. The cache holds
+// at most kLargeObjectCacheSize bytes, and mappings that have not been reused
+// within kLargeObjectCacheDecay milliseconds are returned to the system.
+//
+// Buckets are guarded by spin locks rather than being lock-free stacks, as
+// decaying unmaps mappings that a concurrent pop could still be reading the
+// next pointer of. Cache hits and misses replace a system call anyways.
+class LargeObjectCache {
+ public:
+  // Globally constructed, hence we use staged construction.
+  always_inline LargeObjectCache() {}
+  always_inline ~LargeObjectCache() {}
+
+  always_inline void Init();
+
+  // Makes fork() wait until no bucket is locked, so that the child does not
+  // inherit a held lock. Requires the allocator to be fully set up.
+  always_inline void InstallForkHandlers();
+
+  // Returns a cached mapping of at least *size bytes, or nullptr. In both
+  // cases *size is updated to the size that should be (or has been) mapped.
+  always_inline void* Allocate(size_t* size);
+
+  // Returns true if the mapping has been cached, and false if the caller
+  // should return it to the system.
+  always_inline bool Free(void* mapping, size_t size);
+
+  // Returns mappings that have been cached for longer than the decay time to
+  // the system. Runs at most once per decay interval, and only on one thread.
+  // Called by the scavenger, as well as on allocating and freeing.
+  always_inline void Decay(uint64_t now);
+
+#ifdef PROFILE
+  inline void PrintProfileSummary() {
+    LOG(kWarning,
+        "large object cache: hits: %d, misses: %d, cached bytes: %lu",
+        nr_hits_.load(), nr_misses_.load(), cached_bytes_.load());
+  }
+#endif  // PROFILE
+
+ private:
+  static const int32_t kMinShift = kMaxMediumShift;
+  static const int32_t kBucketsPerShift = 4;
+  static const int32_t kNumBuckets =
+      (kLargeObjectCacheMaxShift - kMinShift) * kBucketsPerShift;
+
+  // Header of a cached mapping.
+  struct CachedMapping {
+    CachedMapping* next;
+    size_t size;
+    uint64_t time;
+  };
+
+  struct Bucket {
+    typedef SpinLock<> Lock;
+
+    Lock lock;
+    CachedMapping* top;
+
+    UNUSED uint8_t pad_[64 - ((sizeof(lock) + sizeof(top)) % 64)];
+  };
+
+  static always_inline int32_t FloorBucket(size_t size);
+  static always_inline size_t BucketSize(int32_t bucket);
+
+  static void LockAllBuckets();
+  static void UnlockAllBuckets();
+
+  std::atomic<size_t> cached_bytes_;
+  std::atomic<uint64_t> last_decay_;
+
+  UNUSED uint8_t pad_[64 - ((sizeof(cached_bytes_) +
+                             sizeof(last_decay_)) % 64)];
+
+  Bucket buckets_[kNumBuckets];
+
+#ifdef PROFILE
+  std::atomic<int32_t> nr_hits_;
+  std::atomic<int32_t> nr_misses_;
+#endif  // PROFILE
+};
+
+
+void LargeObjectCache::Init() {
+  cached_bytes_ = 0;
+  last_decay_ = MonotonicTimeMs();
+  for (int32_t i = 0; i < kNumBuckets; i++) {
+    buckets_[i].top = nullptr;
+  }
+#ifdef PROFILE
+  nr_hits_ = 0;
+  nr_misses_ = 0;
+#endif  // PROFILE
+}
+
+
+void LargeObjectCache::InstallForkHandlers() {
+  if (kLargeObjectCacheSize == 0) {
+    return;
+  }
+  pthread_atfork(LockAllBuckets, UnlockAllBuckets, UnlockAllBuckets);
+}
+
+
+void LargeObjectCache::LockAllBuckets() {
+  for (int32_t i = 0; i < kNumBuckets; i++) {
+    large_object_cache.buckets_[i].lock.Lock();
+  }
+}
+
+
+void LargeObjectCache::UnlockAllBuckets() {
+  for (int32_t i = 0; i < kNumBuckets; i++) {
+    large_object_cache.buckets_[i].lock.Unlock();
+  }
+}
+
+
+// Index of the largest bucket whose size is less or equal than size. May be
+// negative or beyond the last bucket for sizes that are not cached.
+int32_t LargeObjectCache::FloorBucket(size_t size) {
+  const int32_t shift = 63 - __builtin_clzl(size);
+  const int32_t sub = (size >> (shift - 2)) & (kBucketsPerShift - 1);
+  return (shift - kMinShift) * kBucketsPerShift + sub;
+}
+
+
+size_t LargeObjectCache::BucketSize(int32_t bucket) {
+  const int32_t shift = bucket / kBucketsPerShift + kMinShift;
+  const size_t sub = bucket % kBucketsPerShift;
+  return (kBucketsPerShift + sub) << (shift - 2);
+}
+
+
+void* LargeObjectCache::Allocate(size_t* size) {
+  if (kLargeObjectCacheSize == 0) {
+    return nullptr;
+  }
+  int32_t bucket = FloorBucket(*size);
+  if ((bucket < 0) || (bucket >= kNumBuckets)) {
+    return nullptr;
+  }
+  if (BucketSize(bucket) < *size) {
+    bucket++;
+    if (bucket == kNumBuckets) {
+      return nullptr;
+    }
+  }
+  *size = BucketSize(bucket);
+
+  const uint64_t now = MonotonicTimeMs();
+  Decay(now);
+
+  CachedMapping* m;
+  {
+    Bucket::Lock::Guard guard(buckets_[bucket].lock);
+    m = buckets_[bucket].top;
+    if (m != nullptr) {
+      buckets_[bucket].top = m->next;
+    }
+  }
+  if (m == nullptr) {
+#ifdef PROFILE
+    nr_misses_.fetch_add(1);
+#endif  // PROFILE
+    return nullptr;
+  }
+#ifdef PROFILE
+  nr_hits_.fetch_add(1);
+#endif  // PROFILE
+  cached_bytes_.fetch_sub(m->size);
+  *size = m->size;
+  return m;
+}
+
+
+bool LargeObjectCache::Free(void* mapping, size_t size) {
+  if (kLargeObjectCacheSize == 0) {
+    return false;
+  }
+  const int32_t bucket = FloorBucket(size);
+  if ((bucket < 0) || (bucket >= kNumBuckets)) {
+    return false;
+  }
+  if ((cached_bytes_.fetch_add(size) + size) > kLargeObjectCacheSize) {
+    cached_bytes_.fetch_sub(size);
+    return false;
+  }
+
+  const uint64_t now = MonotonicTimeMs();
+  CachedMapping* m = reinterpret_cast<CachedMapping*>(mapping);
+  m->size = size;
+  m->time = now;
+  {
+    Bucket::Lock::Guard guard(buckets_[bucket].lock);
+    m->next = buckets_[bucket].top;
+    buckets_[bucket].top = m;
+  }
+  Decay(now);
+  return true;
+}
+
+
+void LargeObjectCache::Decay(uint64_t now) {
+  uint64_t last = last_decay_.load();
+  if ((now < last) || ((now - last) < kLargeObjectCacheDecay) ||
+      !last_decay_.compare_exchange_strong(last, now)) {
+    return;
+  }
+
+  for (int32_t i = 0; i < kNumBuckets; i++) {
+    // Expired mappings are unlinked while holding the lock, and only unmapped
+    // once nobody can reach them anymore.
+    CachedMapping* expired = nullptr;
+    {
+      Bucket::Lock::Guard guard(buckets_[i].lock);
+      CachedMapping** link = &buckets_[i].top;
+      while (*link != nullptr) {
+        CachedMapping* m = *link;
+        // Mappings may have been cached after now has been taken.
+        if ((m->time <= now) && ((now - m->time) >= kLargeObjectCacheDecay)) {
+          *link = m->next;
+          m->next = expired;
+          expired = m;
+        } else {
+          link = &m->next;
+        }
+      }
+    }
+    while (expired != nullptr) {
+      CachedMapping* m = expired;
+      expired = m->next;
+      cached_bytes_.fetch_sub(m->size);
+      if (munmap(m, m->size) != 0) {
+        Fatal("munmap failed");
+      }
+    }
+  }
+}
+
+}  // namespace scalloc
+
+#endif  // SCALLOC_LARGE_OBJECT_CACHE_H_
@@ -5,6 +5,8 @@
 #ifndef SCALLOC_LOCK_H_
 #define SCALLOC_LOCK_H_
 
+#include <sched.h>
+
 #include <atomic>
 
 #include "log.h"
@@ -21,8 +23,15 @@ class SpinLock {
   always_inline SpinLock() : lock_(0) {}
 
   always_inline void Lock() {
+    // Give up the CPU after a while, since the holder might have been
+    // preempted.
+    int32_t spins = 0;
     while (!TryLock()) {
-      __asm__("PAUSE");
+      if (++spins < kSpinsBeforeYield) {
+        __asm__("PAUSE");
+      } else {
+        sched_yield();
+      }
     }
   }
 
@@ -30,6 +39,8 @@ class SpinLock {
   always_inline void Unlock() { lock_.store(0); }
 
  private:
+  static const int32_t kSpinsBeforeYield = 128;
+
   std::atomic<uint_fast32_t> lock_;
   uint8_t _padding[(PAD != 0) ?  (PAD - sizeof(lock_)) : 0];
 };
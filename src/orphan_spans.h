@@ -0,0 +1,113 @@
+// Copyright (c) 2015, the scalloc project authors.  All rights reserved.
+// Please see the AUTHORS file for details.  Use of this source code is governed
+// by a BSD license that can be found in the LICENSE file.
+
+#ifndef SCALLOC_ORPHAN_SPANS_H_
+#define SCALLOC_ORPHAN_SPANS_H_
+
+#include <stdint.h>
+
+#include <atomic>
+
+#include "core_id.h"
+#include "globals.h"
+#include "log.h"
+#include "platform/assert.h"
+#include "size_classes.h"
+#include "span.h"
+#include "stack.h"
+
+namespace scalloc {
+
+// Partially used spans of terminated cores, waiting to be adopted by other
+// cores.
+//
+// Orphaned spans stay hot, i.e., they can neither be marked for reuse nor be
+// deleted by cores freeing objects to them. They are owned by a dedicated core
+// that never terminates and never allocates, so they are also not revived by
+// freeing cores. All objects freed to an orphaned span thus end up in its
+// remote free list, and the adopting core takes over the span exactly like one
+// of its own hot spans.
+class OrphanSpans {
+ public:
+  // Globally constructed, hence we use staged construction.
+  always_inline OrphanSpans() {}
+  always_inline ~OrphanSpans() {}
+
+  always_inline void Init(Core* owner);
+
+  // The core owning all orphaned spans.
+  always_inline core_id owner() { return core_id(owner_, 0); }
+
+  // Publishes a hot span of old_owner.
+  always_inline void Put(Span* s, core_id old_owner);
+
+  // Returns a span of the given size class which is hot and owned by
+  // new_owner, or nullptr if there is none.
+  always_inline Span* Get(int32_t size_class, core_id new_owner);
+
+#ifdef PROFILE
+  inline void PrintProfileSummary() {
+    LOG(kWarning, "orphan spans: orphaned: %d, adopted: %d",
+        nr_orphaned_.load(), nr_adopted_.load());
+  }
+#endif  // PROFILE
+
+ private:
+  // The first word of a span (its span link) is used by the stacks.
+  typedef Stack<64> SpanStack;
+
+  // Not a core_id, as its constructor would reset the owner if we are
+  // initialized before global construction.
+  Core* owner_;
+
+  UNUSED uint8_t pad_[64 - (sizeof(owner_) % 64)];
+
+  SpanStack spans_[kNumClasses];
+
+#ifdef PROFILE
+  std::atomic<int32_t> nr_orphaned_;
+  std::atomic<int32_t> nr_adopted_;
+#endif  // PROFILE
+};
+
+
+void OrphanSpans::Init(Core* owner) {
+  owner_ = owner;
+#ifdef PROFILE
+  nr_orphaned_ = 0;
+  nr_adopted_ = 0;
+#endif  // PROFILE
+}
+
+
+void OrphanSpans::Put(Span* s, core_id old_owner) {
+  ScallocAssert(Span::IsHot(s->epoch()));
+  const bool success = s->TryReviveNew(old_owner, owner());
+  ScallocAssert(success);
+  spans_[s->size_class()].Push(s);
+#ifdef PROFILE
+  nr_orphaned_.fetch_add(1);
+#endif  // PROFILE
+}
+
+
+Span* OrphanSpans::Get(int32_t size_class, core_id new_owner) {
+  Span* s = reinterpret_cast<Span*>(spans_[size_class].Pop());
+  if (s == nullptr) {
+    return nullptr;
+  }
+  s->SpanLink()->clear_next();
+  const bool success = s->TryReviveNew(owner(), new_owner);
+  ScallocAssert(success);
+  s->MoveRemoteToLocalObjects();
+#ifdef PROFILE
+  nr_adopted_.fetch_add(1);
+#endif  // PROFILE
+  LOG(kTrace, "[%d] adopted span %p", new_owner.tag(), s);
+  return s;
+}
+
+}  // namespace scalloc
+
+#endif  // SCALLOC_ORPHAN_SPANS_H_
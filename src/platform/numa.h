@@ -0,0 +1,99 @@
+// Copyright (c) 2015, the scalloc project authors.  All rights reserved.
+// Please see the AUTHORS file for details.  Use of this source code is governed
+// by a BSD license that can be found in the LICENSE file.
+
+#ifndef SCALLOC_PLATFORM_NUMA_H_
+#define SCALLOC_PLATFORM_NUMA_H_
+
+#include <fcntl.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include "log.h"
+#include "platform/globals.h"
+
+// Thin wrappers around the Linux NUMA system calls. We don't use libnuma since
+// it allocates memory.
+
+namespace scalloc {
+
+const int32_t kMaxNumaNodes = 8;
+
+// Number of NUMA nodes in the system (capped at kMaxNumaNodes), or 1 if NUMA
+// awareness has been disabled by setting the environment variable SCALLOC_NUMA
+// to 0.
+always_inline int32_t NumaNodes() {
+#ifdef __linux__
+  const char* env = getenv("SCALLOC_NUMA");
+  if ((env != nullptr) && (strcmp(env, "0") == 0)) {
+    return 1;
+  }
+  // The file contains a list of ranges, e.g., "0-1,3". We only need the highest
+  // node id.
+  char buf[128];
+  const int fd = open("/sys/devices/system/node/online", O_RDONLY);
+  if (fd == -1) {
+    return 1;
+  }
+  const ssize_t len = read(fd, buf, sizeof(buf) - 1);
+  close(fd);
+  if (len <= 0) {
+    return 1;
+  }
+  int32_t max_node = 0;
+  int32_t node = 0;
+  for (ssize_t i = 0; i < len; i++) {
+    if ((buf[i] >= '0') && (buf[i] <= '9')) {
+      node = node * 10 + (buf[i] - '0');
+      if (node > max_node) {
+        max_node = node;
+      }
+    } else {
+      node = 0;
+    }
+  }
+  if (max_node >= kMaxNumaNodes) {
+    LOG(kWarning, "only using %d of %d NUMA nodes",
+        kMaxNumaNodes, max_node + 1);
+    return kMaxNumaNodes;
+  }
+  return max_node + 1;
+#else
+  return 1;
+#endif  // __linux__
+}
+
+
+// The node the calling thread currently runs on.
+always_inline int32_t CurrentNumaNode() {
+#ifdef __linux__
+  unsigned int node;
+  if (syscall(SYS_getcpu, nullptr, &node, nullptr) != 0) {
+    return 0;
+  }
+  return static_cast<int32_t>(node);
+#else
+  return 0;
+#endif  // __linux__
+}
+
+
+// Sets the memory policy of the given range to prefer the given node. Pages
+// are still allocated on other nodes if the node runs out of memory.
+always_inline void NumaPreferNode(void* p, size_t len, int32_t node) {
+#ifdef __linux__
+  const int kMpolPreferred = 1;
+  unsigned long nodemask = 1UL << node;  // NOLINT
+  if (syscall(SYS_mbind, p, len, kMpolPreferred, &nodemask,
+              sizeof(nodemask) * 8, 0) != 0) {
+    LOG(kWarning, "mbind of %p (node %d) failed", p, node);
+  }
+#endif  // __linux__
+}
+
+}  // namespace scalloc
+
+#endif  // SCALLOC_PLATFORM_NUMA_H_
@@ -21,6 +21,9 @@ extern "C" {
   void* malloc(size_t size) __THROW                 ALIAS(scalloc_malloc);
   void free(void* p) __THROW                        ALIAS(scalloc_free);
   void cfree(void* p) __THROW                       ALIAS(scalloc_free);
+  void free_sized(void* p, size_t size) __THROW     ALIAS(scalloc_free_sized);
+  void free_aligned_sized(void* p, size_t alignment, size_t size) __THROW
+      ALIAS(scalloc_free_aligned_sized);
   void* calloc(size_t nmemb, size_t size) __THROW   ALIAS(scalloc_calloc);
   void* realloc(void* ptr, size_t size) __THROW     ALIAS(scalloc_realloc);
   void* memalign(size_t __alignment, size_t __size) __THROW
@@ -34,6 +37,9 @@ extern "C" {
   void malloc_stats(void) __THROW
       ALIAS(scalloc_malloc_stats);
   int mallopt(int cmd, int value) __THROW           ALIAS(scalloc_mallopt);
+#ifdef SCALLOC_HAVE_MALLINFO2
+  struct mallinfo2 mallinfo2(void) __THROW          ALIAS(scalloc_mallinfo2);
+#endif  // SCALLOC_HAVE_MALLINFO2
 }
 
 #undef ALIAS
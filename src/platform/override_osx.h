@@ -41,6 +41,7 @@ boolean_t mi_check(malloc_zone_t* zone) {
 
 
 void mi_print(malloc_zone_t* zone, boolean_t verbose) {
+  scalloc::malloc_stats();
 }
 
 
@@ -92,6 +93,11 @@ size_t mz_size(malloc_zone_t* zone, const void* p) {
 }
 
 
+void mz_free_definite_size(malloc_zone_t* zone, void* p, size_t size) {
+  scalloc::free_sized(p, size);
+}
+
+
 void* mz_realloc(malloc_zone_t* zone, void* p, size_t size) {
   return scalloc::realloc(p, size);
 }
@@ -114,6 +120,14 @@ void cfree(void* p) {
   scalloc::free(p);
 }
 
+void free_sized(void* p, size_t size) {
+  scalloc::free_sized(p, size);
+}
+
+void free_aligned_sized(void* p, size_t alignment, size_t size) {
+  scalloc::free_aligned_sized(p, alignment, size);
+}
+
 // This function is only available on 10.6 (and later) but the
 // LibSystem headers do not use AvailabilityMacros.h to handle weak
 // importing automatically.  This prototype is a copy of the one in
@@ -144,6 +158,7 @@ always_inline void ReplaceSystemAllocator() {
   scalloc_zone.calloc = &zoned::mz_calloc;
   scalloc_zone.valloc = &zoned::mz_valloc;
   scalloc_zone.free = &zoned::mz_free;
+  scalloc_zone.free_definite_size = &zoned::mz_free_definite_size;
   scalloc_zone.memalign = &zoned::mz_memalign;
   scalloc_zone.realloc = &zoned::mz_realloc;
   scalloc_zone.destroy = &zoned::mz_destroy;
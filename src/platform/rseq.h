@@ -0,0 +1,193 @@
+// Copyright (c) 2015, the scalloc project authors.  All rights reserved.
+// Please see the AUTHORS file for details.  Use of this source code is governed
+// by a BSD license that can be found in the LICENSE file.
+
+#ifndef SCALLOC_PLATFORM_RSEQ_H_
+#define SCALLOC_PLATFORM_RSEQ_H_
+
+#if !defined(__linux__) || !defined(__x86_64__)
+#error "restartable sequences are only supported on Linux/x86_64"
+#endif  // !__linux__ || !__x86_64__
+
+#include <stddef.h>
+#include <stdint.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include "platform/globals.h"
+
+// Restartable sequences (rseq) let a thread operate on per-CPU data without
+// locks or atomic instructions: The kernel aborts (and we restart) a critical
+// section whenever the thread is preempted or migrated before the section's
+// final, committing store.
+
+// Registration by glibc (>= 2.35). Weak, so that we also load with older
+// versions.
+extern "C" const ptrdiff_t __rseq_offset __attribute__((weak));
+extern "C" const unsigned int __rseq_size __attribute__((weak));
+
+namespace scalloc {
+
+// Signature preceding abort handlers. Has to match the one used for
+// registration, i.e., glibc's RSEQ_SIG on x86.
+#define SCALLOC_RSEQ_SIG 0x53053053
+
+// Kernel ABI of struct rseq (see linux/rseq.h).
+struct RseqArea {
+  uint32_t cpu_id_start;
+  uint32_t cpu_id;
+  uint64_t rseq_cs;
+  uint32_t flags;
+} __attribute__((aligned(32)));
+
+const int32_t kRseqCpuIdOffset = 0;
+const int32_t kRseqCsOffset = 8;
+
+// Returns the calling thread's rseq area, registering one if necessary.
+// Returns nullptr if the kernel does not support rseq.
+inline RseqArea* RseqRegister() {
+  static TLS_ATTRIBUTE RseqArea area;
+  if ((&__rseq_size != nullptr) && (__rseq_size > 0)) {
+    uintptr_t tp;
+    __asm__("mov %%fs:0, %0" : "=r"(tp));
+    return reinterpret_cast<RseqArea*>(tp + __rseq_offset);
+  }
+#ifdef SYS_rseq
+  if (syscall(SYS_rseq, &area, sizeof(area), 0, SCALLOC_RSEQ_SIG) == 0) {
+    return &area;
+  }
+#endif  // SYS_rseq
+  return nullptr;
+}
+
+
+// Per-CPU stacks of pointers, laid out as an array of stride bytes per CPU.
+// For a CPU, the current length (uint32_t) is stored at len_offset and the
+// elements at elements_offset.
+//
+// Pops an element from the current CPU's stack, or returns nullptr if the
+// stack is empty.
+always_inline void* RseqPop(RseqArea* rs, uintptr_t base, uintptr_t stride,
+                            uintptr_t len_offset, uintptr_t elements_offset) {
+  void* result;
+  uintptr_t cpu_base;
+  uintptr_t len;
+  __asm__ __volatile__(
+      // Critical section descriptor.
+      ".pushsection __rseq_cs, \"aw\"\n"
+      ".balign 32\n"
+      "3:\n"
+      ".long 0x0\n"
+      ".long 0x0\n"
+      ".quad 4f\n"
+      ".quad 5f - 4f\n"
+      ".quad 6f\n"
+      ".popsection\n"
+      "1:\n"
+      "leaq 3b(%%rip), %[cpu_base]\n"
+      "movq %[cpu_base], %c[cs_offset](%[rs])\n"
+      "4:\n"
+      "movl %c[cpu_offset](%[rs]), %k[cpu_base]\n"
+      "imulq %[stride], %[cpu_base]\n"
+      "addq %[base], %[cpu_base]\n"
+      "movl (%[cpu_base], %[len_offset]), %k[len]\n"
+      "testl %k[len], %k[len]\n"
+      "jz 7f\n"
+      "subl $1, %k[len]\n"
+      "leaq (%[cpu_base], %[elements_offset]), %[result]\n"
+      "movq (%[result], %[len], 8), %[result]\n"
+      // Commit.
+      "movl %k[len], (%[cpu_base], %[len_offset])\n"
+      "5:\n"
+      "jmp 8f\n"
+      "7:\n"
+      "xorl %k[result], %k[result]\n"
+      "8:\n"
+      // Abort handler, preceded by the signature.
+      ".pushsection __rseq_failure, \"ax\"\n"
+      ".byte 0x0f, 0xb9, 0x3d\n"
+      ".long %c[sig]\n"
+      "6:\n"
+      "jmp 1b\n"
+      ".popsection\n"
+      : [result] "=&r"(result),
+        [cpu_base] "=&r"(cpu_base),
+        [len] "=&r"(len)
+      : [rs] "r"(rs),
+        [base] "r"(base),
+        [stride] "r"(stride),
+        [len_offset] "r"(len_offset),
+        [elements_offset] "r"(elements_offset),
+        [cpu_offset] "i"(kRseqCpuIdOffset),
+        [cs_offset] "i"(kRseqCsOffset),
+        [sig] "i"(SCALLOC_RSEQ_SIG)
+      : "cc", "memory");
+  return result;
+}
+
+
+// Pushes p onto the current CPU's stack. Returns false if the stack already
+// holds capacity elements.
+always_inline bool RseqPush(RseqArea* rs, uintptr_t base, uintptr_t stride,
+                            uintptr_t len_offset, uintptr_t elements_offset,
+                            uint32_t capacity, void* p) {
+  uintptr_t result;
+  uintptr_t cpu_base;
+  uintptr_t len;
+  __asm__ __volatile__(
+      ".pushsection __rseq_cs, \"aw\"\n"
+      ".balign 32\n"
+      "3:\n"
+      ".long 0x0\n"
+      ".long 0x0\n"
+      ".quad 4f\n"
+      ".quad 5f - 4f\n"
+      ".quad 6f\n"
+      ".popsection\n"
+      "1:\n"
+      "leaq 3b(%%rip), %[cpu_base]\n"
+      "movq %[cpu_base], %c[cs_offset](%[rs])\n"
+      "4:\n"
+      "movl %c[cpu_offset](%[rs]), %k[cpu_base]\n"
+      "imulq %[stride], %[cpu_base]\n"
+      "addq %[base], %[cpu_base]\n"
+      "movl (%[cpu_base], %[len_offset]), %k[len]\n"
+      "cmpl %k[capacity], %k[len]\n"
+      "jae 7f\n"
+      "leaq (%[cpu_base], %[elements_offset]), %[result]\n"
+      "movq %[p], (%[result], %[len], 8)\n"
+      "addl $1, %k[len]\n"
+      // Commit.
+      "movl %k[len], (%[cpu_base], %[len_offset])\n"
+      "5:\n"
+      "movl $1, %k[result]\n"
+      "jmp 8f\n"
+      "7:\n"
+      "xorl %k[result], %k[result]\n"
+      "8:\n"
+      ".pushsection __rseq_failure, \"ax\"\n"
+      ".byte 0x0f, 0xb9, 0x3d\n"
+      ".long %c[sig]\n"
+      "6:\n"
+      "jmp 1b\n"
+      ".popsection\n"
+      : [result] "=&r"(result),
+        [cpu_base] "=&r"(cpu_base),
+        [len] "=&r"(len)
+      : [rs] "r"(rs),
+        [base] "r"(base),
+        [stride] "r"(stride),
+        [len_offset] "r"(len_offset),
+        [elements_offset] "r"(elements_offset),
+        [capacity] "r"(capacity),
+        [p] "r"(p),
+        [cpu_offset] "i"(kRseqCpuIdOffset),
+        [cs_offset] "i"(kRseqCsOffset),
+        [sig] "i"(SCALLOC_RSEQ_SIG)
+      : "cc", "memory");
+  return result != 0;
+}
+
+}  // namespace scalloc
+
+#endif  // SCALLOC_PLATFORM_RSEQ_H_
@@ -0,0 +1,130 @@
+// Copyright (c) 2015, the scalloc project authors.  All rights reserved.
+// Please see the AUTHORS file for details.  Use of this source code is governed
+// by a BSD license that can be found in the LICENSE file.
+
+#ifndef SCALLOC_REUSABLE_SPANS_H_
+#define SCALLOC_REUSABLE_SPANS_H_
+
+#include <atomic>
+
+#include "core_id.h"
+#include "deque.h"
+#include "globals.h"
+#include "log.h"
+#include "platform/assert.h"
+
+namespace scalloc {
+
+// The set of reusable spans of a single core and size class.
+//
+// Only the owning core operates on the underlying deque. Any core may hand in
+// spans through a lock-free inbox (a push-only Treiber stack) which the owner
+// drains in a single exchange whenever it looks for a span. Since nodes are
+// never popped individually from the inbox, pushing is not subject to ABA.
+//
+// Nodes cannot be removed by other cores. Instead, the span's epoch records
+// whether a span is linked into a set, and whoever unlinks a span that has
+// been marked full in the meantime is in charge of deleting it.
+class ReusableSpans {
+ public:
+  always_inline ReusableSpans();
+
+  // Can be called by any core. Fails if owner is not the current owner of the
+  // set, or if the set has been closed.
+  always_inline bool Push(core_id owner, DoubleListNode* node);
+
+  // Owner only.
+  always_inline DoubleListNode* Pop();
+  always_inline void Open(core_id owner);
+  always_inline void Close();
+
+ private:
+  static DoubleListNode* const kClosed;
+
+  always_inline void Drain(DoubleListNode* chain);
+
+  std::atomic<DoubleListNode*> inbox_;
+  AtomicCoreID owner_;
+  Deque spans_;
+
+  UNUSED char pad_[64 - ((
+      sizeof(inbox_) +
+      sizeof(owner_) +
+      sizeof(spans_)) % 64)];
+};
+
+
+DoubleListNode* const ReusableSpans::kClosed =
+    reinterpret_cast<DoubleListNode*>(0x1);
+
+
+ReusableSpans::ReusableSpans() : inbox_(kClosed) {
+}
+
+
+void ReusableSpans::Open(core_id owner) {
+  ScallocAssert(inbox_.load() == kClosed);
+  owner_.store(owner);
+  inbox_.store(nullptr);
+}
+
+
+void ReusableSpans::Close() {
+  owner_.store(kTerminated);
+  Drain(inbox_.exchange(kClosed));
+}
+
+
+bool ReusableSpans::Push(core_id owner, DoubleListNode* node) {
+  ScallocAssert(node != nullptr);
+  if (owner != owner_.load()) { return false; }
+
+  DoubleListNode* top = inbox_.load();
+  do {
+    if (top == kClosed) { return false; }
+    if (top == nullptr) {
+      node->clear_next();
+    } else {
+      node->set_next(top);
+    }
+  } while (!inbox_.compare_exchange_weak(top, node));
+  return true;
+}
+
+
+DoubleListNode* ReusableSpans::Pop() {
+  DoubleListNode* top = inbox_.load();
+  if ((top != nullptr) && (top != kClosed)) {
+    Drain(inbox_.exchange(nullptr));
+  }
+  return spans_.RemoveBack();
+}
+
+
+// Moves a chain of the inbox (most recent first) to the front of the deque,
+// keeping the order in which spans have been handed in.
+void ReusableSpans::Drain(DoubleListNode* chain) {
+  if ((chain == nullptr) || (chain == kClosed)) { return; }
+
+  DoubleListNode* reversed = nullptr;
+  while (chain != nullptr) {
+    DoubleListNode* next = chain->next();
+    if (reversed == nullptr) {
+      chain->clear_next();
+    } else {
+      chain->set_next(reversed);
+    }
+    reversed = chain;
+    chain = next;
+  }
+  while (reversed != nullptr) {
+    DoubleListNode* next = reversed->next();
+    reversed->clear_next();
+    spans_.PushFront(reversed);
+    reversed = next;
+  }
+}
+
+}  // namespace scalloc
+
+#endif  // SCALLOC_REUSABLE_SPANS_H_
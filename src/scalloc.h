@@ -0,0 +1,117 @@
+/* Copyright (c) 2015, the scalloc project authors.  All rights reserved.
+ * Please see the AUTHORS file for details.  Use of this source code is governed
+ * by a BSD license that can be found in the LICENSE file.
+ *
+ * Public interface of scalloc beyond the standard allocation functions. Usable
+ * from C and C++.
+ */
+
+#ifndef SCALLOC_SCALLOC_H_
+#define SCALLOC_SCALLOC_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Upper bound of the number of size classes reported in scalloc_stats. */
+#define SCALLOC_STATS_MAX_CLASSES 128
+
+struct scalloc_size_class_stats {
+  uint64_t block_size;   /* Size of a block of the class. */
+  uint64_t span_size;    /* Size of a span of the class. */
+  uint64_t allocs;       /* Objects allocated so far. */
+  uint64_t frees;        /* Objects freed so far. */
+  uint64_t live_objects;
+  uint64_t live_bytes;   /* live_objects * block_size. */
+  uint64_t live_spans;   /* Spans that are not in the span pool. */
+
+  /* Fragmentation. Allocated bytes are allocs * block_size. */
+  uint64_t objects_per_span;
+  uint64_t requested_bytes;  /* Bytes requested by all allocations so far. */
+  uint64_t free_objects;     /* Free blocks in live spans. */
+  uint64_t hot_spans;        /* Spans cores allocate from (incl. orphaned). */
+  uint64_t reusable_spans;   /* Spans waiting for reuse by their owner. */
+  uint64_t floating_spans;   /* Spans neither hot nor reusable. */
+};
+
+/* Counters are cumulative since startup unless noted otherwise. Counters are
+ * collected while threads keep allocating, i.e., they are only consistent if
+ * all threads are quiescent. */
+struct scalloc_stats {
+  uint64_t allocs;
+  uint64_t frees;
+  uint64_t local_frees;   /* Frees to spans owned by the freeing core. */
+  uint64_t remote_frees;  /* Frees to spans owned by other cores. */
+
+  uint64_t spans_new;     /* Spans taken from the span pool. */
+  uint64_t spans_reused;  /* Partially used spans reused by their owner. */
+  uint64_t spans_adopted; /* Spans taken over from terminated threads. */
+  uint64_t spans_deleted; /* Spans returned to the span pool. */
+  uint64_t madvise_calls; /* Calls returning span memory to the system. */
+
+  uint64_t live_bytes;    /* Bytes in allocated blocks of size classes. */
+  uint64_t span_bytes;    /* Bytes in spans not in the span pool. */
+  uint64_t rss_bytes;     /* Resident memory of the whole process. */
+
+  uint64_t large_allocs;
+  uint64_t large_frees;
+  uint64_t large_objects; /* Live large objects. */
+  uint64_t large_bytes;   /* Bytes mapped for live large objects. */
+
+  uint32_t num_classes;
+  struct scalloc_size_class_stats classes[SCALLOC_STATS_MAX_CLASSES];
+};
+
+/* Fills in stats with the current allocator statistics. */
+void scalloc_stats(struct scalloc_stats* stats);
+
+/* Writes the live samples of the heap profiler to path, in the heap profile
+ * format understood by pprof. Sampling has to be enabled using the environment
+ * variable SCALLOC_PROFILE_SAMPLE_RATE or mallopt(). Returns 0 on success and
+ * an errno value otherwise. */
+int scalloc_heap_profile_dump(const char* path);
+
+/* Allocation traces, written if scalloc is built with tracing support and the
+ * environment variable SCALLOC_TRACE is set. A trace file starts with a header
+ * followed by records. Records of different threads are written in chunks, so
+ * they have to be sorted by timestamp to restore the order of operations. */
+#define SCALLOC_TRACE_MAGIC 0x3145434152544353ULL  /* "SCTRACE1" */
+#define SCALLOC_TRACE_VERSION 1
+
+enum scalloc_trace_op {
+  SCALLOC_TRACE_MALLOC = 1,
+  SCALLOC_TRACE_CALLOC = 2,
+  SCALLOC_TRACE_MEMALIGN = 3,  /* Any aligned allocation. */
+  SCALLOC_TRACE_REALLOC = 4,
+  SCALLOC_TRACE_FREE = 5,
+};
+
+struct scalloc_trace_header {
+  uint64_t magic;
+  uint32_t version;
+  uint32_t record_size;
+};
+
+/* Objects are identified by their address, which is reused once an object has
+ * been freed. Allocations are timestamped after and frees before the actual
+ * operation, so a freed address only shows up again later on. The only
+ * exception is the old object of a realloc, which may be handed out to another
+ * thread before the realloc is recorded. */
+struct scalloc_trace_record {
+  uint64_t timestamp;        /* Nanoseconds since tracing started. */
+  uint64_t object;           /* Allocated, resized, or freed object. */
+  uint64_t old_object;       /* realloc: object before resizing, or 0. */
+  uint64_t size;             /* Requested size (calloc: nmemb * size). */
+  uint32_t thread;           /* Numbered in order of first traced operation. */
+  uint16_t op;               /* enum scalloc_trace_op */
+  uint16_t alignment_shift;  /* memalign: log2 of the alignment. */
+};
+
+#ifdef __cplusplus
+}  /* extern "C" */
+#endif
+
+#endif  /* SCALLOC_SCALLOC_H_ */
@@ -0,0 +1,210 @@
+// Copyright (c) 2015, the scalloc project authors.  All rights reserved.
+// Please see the AUTHORS file for details.  Use of this source code is governed
+// by a BSD license that can be found in the LICENSE file.
+
+#ifndef SCALLOC_SCAVENGER_H_
+#define SCALLOC_SCAVENGER_H_
+
+#include <pthread.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include <atomic>
+
+#include "core.h"
+#include "core_id.h"
+#include "globals.h"
+#include "large_object_cache.h"
+#include "lock.h"
+#include "log.h"
+#include "span_pool.h"
+#include "utils.h"
+
+// mallopt() parameters. Chosen to not collide with the ones of glibc.
+//
+// Time (in ms) after which unused spans are returned to the system. 0 disables
+// the scavenger.
+#define M_SCALLOC_SCAVENGER_DECAY (-1001)
+// Maximum number of spans returned to the system per second.
+#define M_SCALLOC_SCAVENGER_RATE (-1002)
+
+namespace scalloc {
+
+// A background thread that returns the memory of spans that have been idle in
+// the span pool for a while to the system. Takes madvise calls off the free
+// path and lets idle processes shrink. It also flushes the remote frees that
+// idle threads still buffer, using a core of its own that never allocates, and
+// decays the large object cache, which otherwise only decays on allocating and
+// freeing large objects.
+class Scavenger {
+ public:
+  // Globally constructed, hence we use staged construction.
+  always_inline Scavenger() {}
+  always_inline ~Scavenger() {}
+
+  // Reads the configuration from the environment variables
+  // SCALLOC_SCAVENGER_DECAY and SCALLOC_SCAVENGER_RATE, and starts the
+  // scavenger if enabled. Requires the span pool to be initialized.
+  always_inline void Init();
+
+  // mallopt() style setters. Return 1 on success and 0 on error.
+  always_inline int SetDecay(int decay);
+  always_inline int SetRate(int rate);
+
+ private:
+  typedef SpinLock<> Lock;
+
+  static const uint64_t kMinInterval = 10;
+  static const uint64_t kMaxInterval = 1000;
+
+  static void* Run(void* arg);
+
+  // Forking waits for a running round, as the scavenger may hold locks of
+  // cores and of the large object cache. The child starts a new thread, since
+  // only the forking thread survives.
+  static void PrepareFork();
+  static void ParentAfterFork();
+  static void ChildAfterFork();
+
+  always_inline uint64_t Interval(uint64_t decay);
+  always_inline bool Start();
+
+  std::atomic<uint64_t> decay_;
+  std::atomic<int32_t> rate_;
+  std::atomic<bool> started_;
+  std::atomic<bool> atfork_registered_;
+  Core* core_;
+  Lock round_lock_;
+};
+
+
+void Scavenger::Init() {
+  decay_ = kScavengerDecay;
+  rate_ = kScavengerRate;
+  started_ = false;
+  atfork_registered_ = false;
+  core_ = nullptr;
+  const char* env = getenv("SCALLOC_SCAVENGER_RATE");
+  if (env != nullptr) {
+    rate_ = atoi(env);
+  }
+  env = getenv("SCALLOC_SCAVENGER_DECAY");
+  if (env != nullptr) {
+    decay_ = atoi(env);
+  }
+  if (decay_.load() > 0) {
+    SetDecay(decay_.load());
+  }
+}
+
+
+int Scavenger::SetDecay(int decay) {
+  if (decay < 0) {
+    return 0;
+  }
+  if ((decay > 0) && !Start()) {
+    return 0;
+  }
+  decay_ = decay;
+  span_pool.EnableScavenging(decay > 0);
+  return 1;
+}
+
+
+int Scavenger::SetRate(int rate) {
+  if (rate <= 0) {
+    return 0;
+  }
+  rate_ = rate;
+  return 1;
+}
+
+
+// Scavenge a couple of times per decay period.
+uint64_t Scavenger::Interval(uint64_t decay) {
+  uint64_t interval = decay / 4;
+  if ((decay == 0) || (interval > kMaxInterval)) {
+    interval = kMaxInterval;
+  }
+  if (interval < kMinInterval) {
+    interval = kMinInterval;
+  }
+  return interval;
+}
+
+
+bool Scavenger::Start() {
+  bool expected = false;
+  if (!started_.compare_exchange_strong(expected, true)) {
+    return true;
+  }
+  if (core_ == nullptr) {
+    void* p = core_space.Allocate(sizeof(Core));
+    if (p == nullptr) {
+      LOG(kWarning, "failed to start scavenger: out of memory for its core");
+      started_ = false;
+      return false;
+    }
+    core_ = new(p) Core();
+    core_->Init(core_id(core_, 0));
+  }
+  Core::ShareRemoteFrees();
+  bool registered = false;
+  if (atfork_registered_.compare_exchange_strong(registered, true)) {
+    pthread_atfork(PrepareFork, ParentAfterFork, ChildAfterFork);
+  }
+  pthread_t thread;
+  if (pthread_create(&thread, nullptr, Run, this) != 0) {
+    LOG(kWarning, "failed to start scavenger");
+    started_ = false;
+    return false;
+  }
+  pthread_detach(thread);
+  return true;
+}
+
+
+void* Scavenger::Run(void* arg) {
+  Scavenger* self = reinterpret_cast<Scavenger*>(arg);
+  while (true) {
+    const uint64_t decay = self->decay_.load();
+    const uint64_t interval = self->Interval(decay);
+    usleep(interval * 1000);
+    Lock::Guard guard(self->round_lock_);
+    self->core_->FlushRemoteFreesOfOtherCores();
+    large_object_cache.Decay(MonotonicTimeMs());
+    if (decay == 0) {
+      continue;
+    }
+    int32_t budget = self->rate_.load() * interval / 1000;
+    if (budget < 1) {
+      budget = 1;
+    }
+    const int32_t calls = span_pool.Scavenge(MonotonicTimeMs(), decay, budget);
+    LOG(kTrace, "scavenger: returned %d spans", calls);
+  }
+  return nullptr;
+}
+
+
+void Scavenger::PrepareFork() {
+  scavenger.round_lock_.Lock();
+}
+
+
+void Scavenger::ParentAfterFork() {
+  scavenger.round_lock_.Unlock();
+}
+
+
+void Scavenger::ChildAfterFork() {
+  scavenger.round_lock_.Unlock();
+  if (scavenger.started_.exchange(false)) {
+    scavenger.Start();
+  }
+}
+
+}  // namespace scalloc
+
+#endif  // SCALLOC_SCAVENGER_H_
@@ -19,28 +19,129 @@ extern const int32_t ClassToObjects[];
 extern const int32_t ClassToSize[];
 extern const int32_t ClassToSpanSize[];
 extern const int32_t ClassToReuseThreshold[];
+extern const int32_t ClassToBlockOffset[];
+extern const int32_t ClassToAlignment[];
+
+// Class sizes as known at compile time, from which the SizeToClass() lookup
+// tables are generated.
+constexpr int32_t kClassSizes[] = {
+#define CLASS_SIZE(a, b, c, d) (b),
+FOR_ALL_SIZE_CLASSES(CLASS_SIZE)
+#undef CLASS_SIZE
+};
+
+// Sizes of up to kMaxSmallLookupSize are looked up at a granularity of
+// kMinAlignment. Larger medium sizes are looked up by their power of two and
+// the kMediumLookupBits bits following the leading one, i.e., in quarters of a
+// power of two.
+const size_t kMaxSmallLookupShift = 10;  // 1KiB
+const size_t kMaxSmallLookupSize = 1UL << kMaxSmallLookupShift;
+const size_t kMediumLookupBits = 2;
+const size_t kMediumLookupMask = (1UL << kMediumLookupBits) - 1;
+
+struct cache_aligned SizeClassLookup {
+  uint8_t small[kMaxSmallLookupSize / kMinAlignment + 1];
+  uint8_t medium[(kMaxMediumShift - kMaxSmallLookupShift) <<
+                 kMediumLookupBits];
+};
+
+constexpr int32_t SmallestClassFitting(const size_t size) {
+  int32_t sc = 0;
+  while (static_cast<size_t>(kClassSizes[sc]) < size) {
+    sc++;
+  }
+  return sc;
+}
+
+// Largest size that index i of the medium table stands for. Index i stands
+// for all sizes above the limit of index i - 1.
+constexpr size_t MediumLookupLimit(const size_t i) {
+  return (1UL << (kMaxSmallLookupShift + (i >> kMediumLookupBits))) +
+         ((i & kMediumLookupMask) + 1) *
+             (1UL << (kMaxSmallLookupShift + (i >> kMediumLookupBits) -
+                      kMediumLookupBits));
+}
+
+constexpr SizeClassLookup MakeSizeClassLookup() {
+  SizeClassLookup lookup = {};
+  for (size_t i = 0; i < sizeof(lookup.small); i++) {
+    lookup.small[i] = SmallestClassFitting(i * kMinAlignment);
+  }
+  for (size_t i = 0; i < sizeof(lookup.medium); i++) {
+    lookup.medium[i] = SmallestClassFitting(MediumLookupLimit(i));
+  }
+  return lookup;
+}
+
+// Whether all sizes sharing an entry of the lookup tables map to the same
+// class, i.e., whether class sizes fall onto the granularity of their table.
+constexpr bool SizeClassLookupIsExact() {
+  for (size_t i = 1; i < sizeof(SizeClassLookup::small); i++) {
+    if (SmallestClassFitting((i - 1) * kMinAlignment + 1) !=
+        SmallestClassFitting(i * kMinAlignment)) {
+      return false;
+    }
+  }
+  size_t min = kMaxSmallLookupSize + 1;
+  for (size_t i = 0; i < sizeof(SizeClassLookup::medium); i++) {
+    if (SmallestClassFitting(min) !=
+        SmallestClassFitting(MediumLookupLimit(i))) {
+      return false;
+    }
+    min = MediumLookupLimit(i) + 1;
+  }
+  return true;
+}
+
+static_assert(kClassSizes[kNumClasses - 1] == kMaxMediumSize,
+              "the largest size class has to be kMaxMediumSize");
+static_assert(SizeClassLookupIsExact(),
+              "size classes do not fall onto the SizeToClass() lookup tables");
+
+inline constexpr SizeClassLookup kSizeClassLookup = MakeSizeClassLookup();
 
 always_inline int32_t SizeToClass(const size_t size) __attribute__((pure));
 always_inline int32_t SizeToBlockSize(const size_t size) __attribute__((pure));
+always_inline int32_t AlignedSizeToClass(const size_t size,
+                                         const size_t alignment)
+    __attribute__((pure));
 
 
 int32_t SizeToClass(const size_t size) {
-  if (size <= kMaxSmallSize) {
-    return (size + kMinAlignment - 1) / kMinAlignment;
+  if (LIKELY(size <= kMaxSmallLookupSize)) {
+    return kSizeClassLookup.small[(size + kMinAlignment - 1) / kMinAlignment];
   }
   if (size <= kMaxMediumSize) {
-    return Log2(size - 1) - kMaxSmallShift + kFineClasses;
+    // Power of two and the following kMediumLookupBits bits of size - 1.
+    const size_t v = size - 1;
+    const size_t shift = 63 - __builtin_clzl(v);
+    return kSizeClassLookup.medium[
+        ((shift - kMaxSmallLookupShift) << kMediumLookupBits) |
+        ((v >> (shift - kMediumLookupBits)) & kMediumLookupMask)];
   }
   // 0 indicates size of 0 or large objects.
   return 0;
 }
 
 
+// Returns the smallest size class that fits size and whose blocks are all
+// aligned to alignment, or 0 if there is none.
+int32_t AlignedSizeToClass(const size_t size, const size_t alignment) {
+  int32_t sc = SizeToClass(size);
+  if (sc == 0) {
+    return 0;
+  }
+  while ((sc < kNumClasses) &&
+         (static_cast<size_t>(ClassToAlignment[sc]) < alignment)) {
+    sc++;
+  }
+  return (sc < kNumClasses) ? sc : 0;
+}
+
+
 int32_t SizeToBlockSize(const size_t size) {
-  if (size <= kMaxSmallSize) {
-    return (size + kMinAlignment - 1) & ~(kMinAlignment-1);
-  } else if (size <= kMaxMediumSize) {
-    return 1UL << (Log2(size - 1) + 1);
+  if (size <= kMaxMediumSize) {
+    return ClassToSize[SizeToClass(size)];
   }
   UNREACHABLE();
   return 0;
@@ -7,13 +7,88 @@
 //                          |  DO NOT EDIT!  |
 //                          +----------------+
 //
-// This file is auto-generated using ``tools/gen_size_classes.py huge''
+// This file is auto-generated using ``tools/gen_size_classes.py huge dense''
 
 #ifndef SCALLOC_SIZE_CLASSES_RAW_H_
 #define SCALLOC_SIZE_CLASSES_RAW_H_
 
 const int32_t kSpanHeaderSize = 128;
 
+#if defined(SCALLOC_SIZE_CLASSES_DENSE)
+
+const int32_t kNumClasses = 65;
+
+#define FOR_ALL_SIZE_CLASSES(V) \
+  V(0, 0, 0, 0) /* NOLINT */ \
+  V(1, 16, 32768, (32768 - kSpanHeaderSize)/16) /* NOLINT */ \
+  V(2, 32, 32768, (32768 - kSpanHeaderSize)/32) /* NOLINT */ \
+  V(3, 48, 32768, (32768 - kSpanHeaderSize)/48) /* NOLINT */ \
+  V(4, 64, 32768, (32768 - kSpanHeaderSize)/64) /* NOLINT */ \
+  V(5, 80, 32768, (32768 - kSpanHeaderSize)/80) /* NOLINT */ \
+  V(6, 96, 32768, (32768 - kSpanHeaderSize)/96) /* NOLINT */ \
+  V(7, 112, 32768, (32768 - kSpanHeaderSize)/112) /* NOLINT */ \
+  V(8, 128, 32768, (32768 - kSpanHeaderSize)/128) /* NOLINT */ \
+  V(9, 144, 32768, (32768 - kSpanHeaderSize)/144) /* NOLINT */ \
+  V(10, 160, 32768, (32768 - kSpanHeaderSize)/160) /* NOLINT */ \
+  V(11, 176, 32768, (32768 - kSpanHeaderSize)/176) /* NOLINT */ \
+  V(12, 192, 32768, (32768 - kSpanHeaderSize)/192) /* NOLINT */ \
+  V(13, 208, 32768, (32768 - kSpanHeaderSize)/208) /* NOLINT */ \
+  V(14, 224, 32768, (32768 - kSpanHeaderSize)/224) /* NOLINT */ \
+  V(15, 240, 32768, (32768 - kSpanHeaderSize)/240) /* NOLINT */ \
+  V(16, 256, 32768, (32768 - kSpanHeaderSize)/256) /* NOLINT */ \
+  V(17, 320, ((75 + 1) * 320 + kPageSize - 1)/kPageSize * kPageSize, 75) /* NOLINT */ \
+  V(18, 384, ((73 + 1) * 384 + kPageSize - 1)/kPageSize * kPageSize, 73) /* NOLINT */ \
+  V(19, 448, ((71 + 1) * 448 + kPageSize - 1)/kPageSize * kPageSize, 71) /* NOLINT */ \
+  V(20, 512, ((70 + 1) * 512 + kPageSize - 1)/kPageSize * kPageSize, 70) /* NOLINT */ \
+  V(21, 640, ((69 + 1) * 640 + kPageSize - 1)/kPageSize * kPageSize, 69) /* NOLINT */ \
+  V(22, 768, ((68 + 1) * 768 + kPageSize - 1)/kPageSize * kPageSize, 68) /* NOLINT */ \
+  V(23, 896, ((67 + 1) * 896 + kPageSize - 1)/kPageSize * kPageSize, 67) /* NOLINT */ \
+  V(24, 1024, ((66 + 1) * 1024 + kPageSize - 1)/kPageSize * kPageSize, 66) /* NOLINT */ \
+  V(25, 1280, ((66 + 1) * 1280 + kPageSize - 1)/kPageSize * kPageSize, 66) /* NOLINT */ \
+  V(26, 1536, ((65 + 1) * 1536 + kPageSize - 1)/kPageSize * kPageSize, 65) /* NOLINT */ \
+  V(27, 1792, ((65 + 1) * 1792 + kPageSize - 1)/kPageSize * kPageSize, 65) /* NOLINT */ \
+  V(28, 2048, ((64 + 1) * 2048 + kPageSize - 1)/kPageSize * kPageSize, 64) /* NOLINT */ \
+  V(29, 2560, ((34 + 1) * 2560 + kPageSize - 1)/kPageSize * kPageSize, 34) /* NOLINT */ \
+  V(30, 3072, ((32 + 1) * 3072 + kPageSize - 1)/kPageSize * kPageSize, 32) /* NOLINT */ \
+  V(31, 3584, ((32 + 1) * 3584 + kPageSize - 1)/kPageSize * kPageSize, 32) /* NOLINT */ \
+  V(32, 4096, ((32 + 1) * 4096 + kPageSize - 1)/kPageSize * kPageSize, 32) /* NOLINT */ \
+  V(33, 5120, ((33 + 1) * 5120 + kPageSize - 1)/kPageSize * kPageSize, 33) /* NOLINT */ \
+  V(34, 6144, ((32 + 1) * 6144 + kPageSize - 1)/kPageSize * kPageSize, 32) /* NOLINT */ \
+  V(35, 7168, ((32 + 1) * 7168 + kPageSize - 1)/kPageSize * kPageSize, 32) /* NOLINT */ \
+  V(36, 8192, ((32 + 1) * 8192 + kPageSize - 1)/kPageSize * kPageSize, 32) /* NOLINT */ \
+  V(37, 10240, ((16 + 1) * 10240 + kPageSize - 1)/kPageSize * kPageSize, 16) /* NOLINT */ \
+  V(38, 12288, ((16 + 1) * 12288 + kPageSize - 1)/kPageSize * kPageSize, 16) /* NOLINT */ \
+  V(39, 14336, ((16 + 1) * 14336 + kPageSize - 1)/kPageSize * kPageSize, 16) /* NOLINT */ \
+  V(40, 16384, ((16 + 1) * 16384 + kPageSize - 1)/kPageSize * kPageSize, 16) /* NOLINT */ \
+  V(41, 20480, ((16 + 1) * 20480 + kPageSize - 1)/kPageSize * kPageSize, 16) /* NOLINT */ \
+  V(42, 24576, ((16 + 1) * 24576 + kPageSize - 1)/kPageSize * kPageSize, 16) /* NOLINT */ \
+  V(43, 28672, ((16 + 1) * 28672 + kPageSize - 1)/kPageSize * kPageSize, 16) /* NOLINT */ \
+  V(44, 32768, ((16 + 1) * 32768 + kPageSize - 1)/kPageSize * kPageSize, 16) /* NOLINT */ \
+  V(45, 40960, ((16 + 1) * 40960 + kPageSize - 1)/kPageSize * kPageSize, 16) /* NOLINT */ \
+  V(46, 49152, ((16 + 1) * 49152 + kPageSize - 1)/kPageSize * kPageSize, 16) /* NOLINT */ \
+  V(47, 57344, ((16 + 1) * 57344 + kPageSize - 1)/kPageSize * kPageSize, 16) /* NOLINT */ \
+  V(48, 65536, ((16 + 1) * 65536 + kPageSize - 1)/kPageSize * kPageSize, 16) /* NOLINT */ \
+  V(49, 81920, ((8 + 1) * 81920 + kPageSize - 1)/kPageSize * kPageSize, 8) /* NOLINT */ \
+  V(50, 98304, ((8 + 1) * 98304 + kPageSize - 1)/kPageSize * kPageSize, 8) /* NOLINT */ \
+  V(51, 114688, ((8 + 1) * 114688 + kPageSize - 1)/kPageSize * kPageSize, 8) /* NOLINT */ \
+  V(52, 131072, ((8 + 1) * 131072 + kPageSize - 1)/kPageSize * kPageSize, 8) /* NOLINT */ \
+  V(53, 163840, ((4 + 1) * 163840 + kPageSize - 1)/kPageSize * kPageSize, 4) /* NOLINT */ \
+  V(54, 196608, ((4 + 1) * 196608 + kPageSize - 1)/kPageSize * kPageSize, 4) /* NOLINT */ \
+  V(55, 229376, ((4 + 1) * 229376 + kPageSize - 1)/kPageSize * kPageSize, 4) /* NOLINT */ \
+  V(56, 262144, ((4 + 1) * 262144 + kPageSize - 1)/kPageSize * kPageSize, 4) /* NOLINT */ \
+  V(57, 327680, ((2 + 1) * 327680 + kPageSize - 1)/kPageSize * kPageSize, 2) /* NOLINT */ \
+  V(58, 393216, ((2 + 1) * 393216 + kPageSize - 1)/kPageSize * kPageSize, 2) /* NOLINT */ \
+  V(59, 458752, ((2 + 1) * 458752 + kPageSize - 1)/kPageSize * kPageSize, 2) /* NOLINT */ \
+  V(60, 524288, ((2 + 1) * 524288 + kPageSize - 1)/kPageSize * kPageSize, 2) /* NOLINT */ \
+  V(61, 655360, ((1 + 1) * 655360 + kPageSize - 1)/kPageSize * kPageSize, 1) /* NOLINT */ \
+  V(62, 786432, ((1 + 1) * 786432 + kPageSize - 1)/kPageSize * kPageSize, 1) /* NOLINT */ \
+  V(63, 917504, ((1 + 1) * 917504 + kPageSize - 1)/kPageSize * kPageSize, 1) /* NOLINT */ \
+  V(64, 1048576, ((1 + 1) * 1048576 + kPageSize - 1)/kPageSize * kPageSize, 1) /* NOLINT */
+
+#else  // huge
+
+const int32_t kNumClasses = 29;
+
 #define FOR_ALL_SIZE_CLASSES(V) \
   V(0, 0, 0, 0) /* NOLINT */ \
   V(1, 16, 32768, (32768 - kSpanHeaderSize)/16) /* NOLINT */ \
@@ -32,17 +107,19 @@ const int32_t kSpanHeaderSize = 128;
   V(14, 224, 32768, (32768 - kSpanHeaderSize)/224) /* NOLINT */ \
   V(15, 240, 32768, (32768 - kSpanHeaderSize)/240) /* NOLINT */ \
   V(16, 256, 32768, (32768 - kSpanHeaderSize)/256) /* NOLINT */ \
-  V(17, 512, ((64 * 512 + kSpanHeaderSize)/kPageSize + 1) * kPageSize, 64) /* NOLINT */ \
-  V(18, 1024, ((64 * 1024 + kSpanHeaderSize)/kPageSize + 1) * kPageSize, 64) /* NOLINT */ \
-  V(19, 2048, ((64 * 2048 + kSpanHeaderSize)/kPageSize + 1) * kPageSize, 64) /* NOLINT */ \
-  V(20, 4096, ((32 * 4096 + kSpanHeaderSize)/kPageSize + 1) * kPageSize, 32) /* NOLINT */ \
-  V(21, 8192, ((32 * 8192 + kSpanHeaderSize)/kPageSize + 1) * kPageSize, 32) /* NOLINT */ \
-  V(22, 16384, ((16 * 16384 + kSpanHeaderSize)/kPageSize + 1) * kPageSize, 16) /* NOLINT */ \
-  V(23, 32768, ((16 * 32768 + kSpanHeaderSize)/kPageSize + 1) * kPageSize, 16) /* NOLINT */ \
-  V(24, 65536, ((16 * 65536 + kSpanHeaderSize)/kPageSize + 1) * kPageSize, 16) /* NOLINT */ \
-  V(25, 131072, ((8 * 131072 + kSpanHeaderSize)/kPageSize + 1) * kPageSize, 8) /* NOLINT */ \
-  V(26, 262144, ((4 * 262144 + kSpanHeaderSize)/kPageSize + 1) * kPageSize, 4) /* NOLINT */ \
-  V(27, 524288, ((2 * 524288 + kSpanHeaderSize)/kPageSize + 1) * kPageSize, 2) /* NOLINT */ \
-  V(28, 1048576, ((1 * 1048576 + kSpanHeaderSize)/kPageSize + 1) * kPageSize, 1) /* NOLINT */
+  V(17, 512, ((64 + 1) * 512 + kPageSize - 1)/kPageSize * kPageSize, 64) /* NOLINT */ \
+  V(18, 1024, ((64 + 1) * 1024 + kPageSize - 1)/kPageSize * kPageSize, 64) /* NOLINT */ \
+  V(19, 2048, ((64 + 1) * 2048 + kPageSize - 1)/kPageSize * kPageSize, 64) /* NOLINT */ \
+  V(20, 4096, ((32 + 1) * 4096 + kPageSize - 1)/kPageSize * kPageSize, 32) /* NOLINT */ \
+  V(21, 8192, ((32 + 1) * 8192 + kPageSize - 1)/kPageSize * kPageSize, 32) /* NOLINT */ \
+  V(22, 16384, ((16 + 1) * 16384 + kPageSize - 1)/kPageSize * kPageSize, 16) /* NOLINT */ \
+  V(23, 32768, ((16 + 1) * 32768 + kPageSize - 1)/kPageSize * kPageSize, 16) /* NOLINT */ \
+  V(24, 65536, ((16 + 1) * 65536 + kPageSize - 1)/kPageSize * kPageSize, 16) /* NOLINT */ \
+  V(25, 131072, ((8 + 1) * 131072 + kPageSize - 1)/kPageSize * kPageSize, 8) /* NOLINT */ \
+  V(26, 262144, ((4 + 1) * 262144 + kPageSize - 1)/kPageSize * kPageSize, 4) /* NOLINT */ \
+  V(27, 524288, ((2 + 1) * 524288 + kPageSize - 1)/kPageSize * kPageSize, 2) /* NOLINT */ \
+  V(28, 1048576, ((1 + 1) * 1048576 + kPageSize - 1)/kPageSize * kPageSize, 1) /* NOLINT */
+
+#endif
 
 #endif  // SCALLOC_SIZE_CLASSES_RAW_H_
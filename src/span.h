@@ -21,16 +21,8 @@
 
 namespace scalloc {
 
-#ifdef PROFILE
-extern std::atomic<int32_t> local_frees;
-extern std::atomic<int32_t> remote_frees;
-#endif  // PROFILE
-
-
 class Span {
  public:
-  static const int_fast32_t kAlignTag = 0xAAAAAAAA;
-
   static always_inline bool IsFloatingOrReusable(int32_t epoch) {
     return !IsFull(epoch) && !IsHot(epoch);
   }
@@ -47,25 +39,42 @@ class Span {
     return (epoch & kEpochFull);
   }
 
+  static always_inline bool IsLinked(int32_t epoch) {
+    return (epoch & kEpochLinked) != 0;
+  }
+
   static always_inline Span* FromObject(const void* p);
   static always_inline Span* FromSpanLink(DoubleListNode* link);
   static always_inline Span* New(size_t size_class, core_id owner);
   static always_inline void Delete(Span* s);
 
   always_inline void* Allocate();
+  always_inline void* Allocate(bool* zeroed);
+  always_inline int32_t AllocateBatch(void** objs, int32_t max);
   always_inline int32_t Free(void* p, core_id caller);
-  always_inline void* AlignToBlockStart(void* p);
+  always_inline int32_t FreeRemoteRange(void* start, void* end, int32_t len);
   always_inline void MoveRemoteToLocalObjects();
 
   always_inline size_t size_class();
   always_inline core_id owner();
   always_inline DoubleListNode* SpanLink();
   always_inline int32_t epoch();
+
+#ifdef SCALLOC_HEAP_PROFILER
+  // Number of objects of the span sampled by the heap profiler. Only a hint for
+  // frees whether to look for a sample, i.e., may be too large.
+  always_inline bool HasSamples() {
+    return nr_samples_.load(std::memory_order_relaxed) != 0;
+  }
+  always_inline void AddSample() { nr_samples_.fetch_add(1); }
+  always_inline void RemoveSample() { nr_samples_.fetch_sub(1); }
+#endif  // SCALLOC_HEAP_PROFILER
   always_inline bool NewMarkHot(int32_t old_epoch);
-  always_inline bool NewMarkFull(int32_t old_epoch);
+  always_inline bool NewMarkFull(int32_t old_epoch, bool* linked);
   always_inline bool NewMarkReuse(int32_t old_epoch);
   always_inline void NewMarkFloating();
   always_inline bool TryMarkFloating(int32_t old_epoch);
+  always_inline bool Unlink();
   always_inline bool TryReviveNew(core_id old_owner, core_id caller);
 
   always_inline int_fast32_t NrFreeObjects() {
@@ -76,16 +85,20 @@ class Span {
  private:
   typedef Stack<64> RemoteFreeList;
 
+  // The linked bit is orthogonal to the states. It is set while a span is
+  // (about to be) linked into the reusable spans of its owner.
   enum EpochBit {
     kHotBit = 31,
     kFullBit = 30,
     kReuseBit = 29,
-    kLastValueBit = 28
+    kLinkedBit = 28,
+    kLastValueBit = 27
   };
   enum EpochValue {
     kEpochHot = (1 << kHotBit),
     kEpochFull = (1 << kFullBit),
     kEpochReuse = (1 << kReuseBit),
+    kEpochLinked = (1 << kLinkedBit),
   };
   enum EpochMask {
     kEpochOnlyValuesMask = (1 << kLastValueBit) - 1,
@@ -102,9 +115,10 @@ class Span {
     return local_free_list_.Length();
   }
 
-  always_inline Span(size_t sc, core_id owner);
+  always_inline Span(size_t sc, core_id owner, size_t zero_offset);
   always_inline void CheckAlignments();
   always_inline intptr_t HeaderEnd();
+  always_inline intptr_t BlockStart(size_t size_class);
 
   // This list is used to link up reusable spans in the corresponding core. The
   // first word is also used in the span pool to link up spans.
@@ -116,8 +130,17 @@ class Span {
   // pool.
   std::atomic<int32_t> epoch_;
 
-  int32_t size_class_;
-  UNUSED  char padding_[8];
+  // Both fit into 16 bits, which keeps the remote free list on its own cache
+  // line.
+  uint16_t size_class_;
+#ifdef SCALLOC_HEAP_PROFILER
+  std::atomic<uint16_t> nr_samples_;
+#endif  // SCALLOC_HEAP_PROFILER
+
+  // Objects from the bump pointer region starting at or after this address
+  // are known to be zero.
+  intptr_t zero_start_;
+
   IncrementalFreeList local_free_list_;
 
   RemoteFreeList remote_free_list_;
@@ -129,6 +152,7 @@ class Span {
   V(owner_)                                                                    \
   V(epoch_)                                                                    \
   V(size_class_)                                                               \
+  V(zero_start_)                                                               \
   V(local_free_list_)                                                          \
   V(remote_free_list_)                                                         \
 
@@ -145,8 +169,9 @@ Span* Span::FromSpanLink(DoubleListNode* link) {
 
 
 Span* Span::New(size_t size_class, core_id owner) {
-  return new(span_pool.Allocate(size_class, owner.tag()))
-         Span(size_class, owner);
+  size_t zero_offset;
+  void* p = span_pool.Allocate(size_class, owner.tag(), &zero_offset);
+  return new(p) Span(size_class, owner, zero_offset);
 }
 
 
@@ -157,33 +182,23 @@ void Span::Delete(Span* s) {
 }
 
 
-void* Span::AlignToBlockStart(void* p) {
-  // Check if realigning is needed.
-  if (*reinterpret_cast<int_fast32_t*>(
-          reinterpret_cast<uintptr_t>(p) - sizeof(int_fast32_t)) == kAlignTag) {
-    const uintptr_t d =
-        (reinterpret_cast<uintptr_t>(p) - HeaderEnd())
-          % ClassToSize[size_class_];
-    LOG(kWarning, "found aligned adr: %p", p);
-    p = reinterpret_cast<void*>(reinterpret_cast<uintptr_t>(p) - d);
-    LOG(kWarning, "  fix to: %p", p);
-  }
-  return p;
-}
-
-
-Span::Span(size_t size_class, core_id owner)
+Span::Span(size_t size_class, core_id owner, size_t zero_offset)
     : span_link_()
     , owner_(owner)
     , size_class_(size_class)
-    , local_free_list_(HeaderEnd(), size_class)
+#ifdef SCALLOC_HEAP_PROFILER
+    , nr_samples_(0)
+#endif  // SCALLOC_HEAP_PROFILER
+    , zero_start_(reinterpret_cast<intptr_t>(this) + zero_offset)
+    , local_free_list_(BlockStart(size_class), size_class)
     , remote_free_list_() {
   ScallocAssert(local_free_list_.Length() == ClassToObjects[size_class]);
   ScallocAssert(remote_free_list_.Length() == 0);
   ScallocAssert(owner.value() != nullptr);
 
-  // Mark span as hot.
-  NewMarkHot(epoch());
+  // Mark span as hot. A recycled span still carries the full mark of its
+  // previous use, which would let NewMarkHot() fail.
+  epoch_.store(((epoch() + 1) | kEpochHot) & kEpochHotMask);
 
 #ifdef DEBUG
   CheckAlignments();
@@ -208,6 +223,13 @@ intptr_t Span::HeaderEnd() {
 }
 
 
+intptr_t Span::BlockStart(size_t size_class) {
+  ScallocAssert(ClassToBlockOffset[size_class] >= HeaderEnd() -
+                reinterpret_cast<intptr_t>(this));
+  return reinterpret_cast<intptr_t>(this) + ClassToBlockOffset[size_class];
+}
+
+
 DoubleListNode* Span::SpanLink() {
   ScallocAssert(&span_link_ == reinterpret_cast<DoubleListNode*>(this));
   return &span_link_;
@@ -222,22 +244,44 @@ bool Span::NewMarkHot(int32_t old_epoch) {
 }
 
 
-bool Span::NewMarkFull(int32_t old_epoch) {
-  // Reuse bit can be set, but nothing else.
-  old_epoch &= kEpochReuseMask;
-  int32_t new_epoch = ((old_epoch + 1) | kEpochFull) & kEpochFullMask;
-  return epoch_.compare_exchange_strong(old_epoch, new_epoch);
+// Sets linked iff the span is still linked into a set of reusable spans, in
+// which case the core unlinking it is responsible for deleting it.
+bool Span::NewMarkFull(int32_t old_epoch, bool* linked) {
+  // Reuse bit can be set, but nothing else. The linked bit is retained and may
+  // change concurrently.
+  old_epoch &= kEpochReuseMask | kEpochLinked;
+  const int32_t expected = old_epoch & kEpochReuseMask;
+  int32_t new_epoch;
+  do {
+    new_epoch = (((old_epoch + 1) | kEpochFull) & kEpochFullMask) |
+                (old_epoch & kEpochLinked);
+    if (epoch_.compare_exchange_strong(old_epoch, new_epoch)) {
+      *linked = IsLinked(new_epoch);
+      return true;
+    }
+  } while ((old_epoch & ~kEpochLinked) == expected);
+  return false;
 }
 
 
 bool Span::NewMarkReuse(int32_t old_epoch) {
-  // None of the bits should be set.
+  // None of the bits should be set. The span will be linked by the caller.
   old_epoch &= kEpochOnlyValuesMask;
-  int32_t new_epoch = ((old_epoch  + 1) | kEpochReuse) & kEpochReuseMask;
+  int32_t new_epoch =
+      (((old_epoch  + 1) | kEpochReuse) & kEpochReuseMask) | kEpochLinked;
   return epoch_.compare_exchange_strong(old_epoch, new_epoch);
 }
 
 
+// Clears the linked bit. Returns true if the span has been marked full while it
+// was linked, i.e., the caller has to delete it.
+bool Span::Unlink() {
+  const int32_t old_epoch = epoch_.fetch_and(~kEpochLinked);
+  ScallocAssert(IsLinked(old_epoch));
+  return IsFull(old_epoch);
+}
+
+
 void Span::NewMarkFloating() {
   // There's no race in this one as we always go through the hot state which
   // is already exclusive.
@@ -246,7 +290,7 @@ void Span::NewMarkFloating() {
 
 
 bool Span::TryMarkFloating(int32_t old_epoch) {
-  int32_t new_epoch = old_epoch & kEpochOnlyValuesMask;
+  int32_t new_epoch = old_epoch & (kEpochOnlyValuesMask | kEpochLinked);
   return epoch_.compare_exchange_strong(old_epoch, new_epoch);
 }
 
@@ -278,20 +322,32 @@ void* Span::Allocate() {
 }
 
 
+// Allocates an object and reports whether its memory is known to be zero.
+void* Span::Allocate(bool* zeroed) {
+  void* p = local_free_list_.Pop(zeroed);
+  *zeroed = *zeroed && (reinterpret_cast<intptr_t>(p) >= zero_start_);
+  return p;
+}
+
+
+int32_t Span::AllocateBatch(void** objs, int32_t max) {
+  return local_free_list_.PopBatch(objs, max);
+}
+
+
 int32_t Span::Free(void* p, core_id caller) {
   if (owner() == caller) {  // Local free.
-#ifdef PROFILE
-    local_frees.fetch_add(1);
-#endif  // PROFILE
     return local_free_list_.Push(p) + NrRemoteObjects();
   } else {  // Remote free.
-#ifdef PROFILE
-    remote_frees.fetch_add(1);
-#endif  // PROFILE
     return remote_free_list_.PushReturnTag(p) + NrLocalObjects();
   }
 }
 
+// Frees a pre-linked list of len objects as remote objects using a single CAS.
+int32_t Span::FreeRemoteRange(void* start, void* end, int32_t len) {
+  return remote_free_list_.PushRange(start, end, len) + NrLocalObjects();
+}
+
 always_inline void Span::MoveRemoteToLocalObjects() {
   if (NrRemoteObjects() != 0) {
     int32_t actual_len = 0;
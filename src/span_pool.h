@@ -5,6 +5,9 @@
 #ifndef SCALLOC_SPAN_POOL_H_
 #define SCALLOC_SPAN_POOL_H_
 
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
 #include <sys/mman.h>
 
 #include <atomic>
@@ -12,8 +15,16 @@
 #include "arena.h"
 #include "globals.h"
 #include "lock.h"
+#ifdef SCALLOC_NUMA
+#include "platform/numa.h"
+#endif  // SCALLOC_NUMA
 #include "size_classes.h"
 #include "stack.h"
+#include "utils.h"
+
+// mallopt() parameter selecting the purge strategy, i.e., one of
+// SCALLOC_PURGE_{DONTNEED,FREE,NONE}.
+#define M_SCALLOC_PURGE (-1003)
 
 namespace scalloc {
 
@@ -24,17 +35,35 @@ class SpanPool {
   always_inline ~SpanPool() {}
 
   always_inline void Init();
-  always_inline void* Allocate(size_t size_class, int32_t id);
+  always_inline void* Allocate(size_t size_class, int32_t id,
+                               size_t* zero_offset);
   always_inline void Free(size_t size_class, void* p, int32_t id);
 
   always_inline void AnnounceNewThread();
   always_inline void AnnounceLeavingThread();
 
+  // While scavenging is enabled, spans are never madvised eagerly upon Free.
+  // Instead, Scavenge() has to be called periodically.
+  always_inline void EnableScavenging(bool enabled) { scavenging_ = enabled; }
+
+  // Returns the memory of spans that have been in the pool for at least decay
+  // ms to the system, using at most budget madvise calls. Returns the number
+  // of calls made.
+  always_inline int32_t Scavenge(uint64_t now, uint64_t decay, int32_t budget);
+
+  // mallopt() style setter. Returns 1 on success and 0 on error.
+  always_inline int SetPurgeStrategy(int strategy);
+
+  // Number of calls returning memory of spans to the system.
+  always_inline uint64_t madvise_calls() {
+    return nr_madvise_.load(std::memory_order_relaxed);
+  }
+
 #ifdef PROFILE
   inline void PrintProfileSummary() {
     LOG(kWarning,
-        "span pool: allocations: %d,  deallocations: %d",
-        nr_allocate_.load(), nr_free_.load());
+        "span pool: allocations: %d,  deallocations: %d, madvise: %lu",
+        nr_allocate_.load(), nr_free_.load(), nr_madvise_.load());
   }
 #endif  // PROFILE
 
@@ -45,10 +74,56 @@ class SpanPool {
 #else
   static const int32_t kHardLimit = 16384;
 #endif  // SCALLOC_SPAN_POOL_BACKEND_LIMIT
+#ifdef SCALLOC_NUMA
+  static const int32_t kMaxNodes = kMaxNumaNodes;
+#else
+  static const int32_t kMaxNodes = 1;
+#endif  // SCALLOC_NUMA
 
   typedef Stack<64> Backend;
 
+  // Header of a span in the pool. The first word is used by the backend.
+  struct PooledSpan {
+    void* next;
+    // Offset from which on the span's memory is known to be zero.
+    size_t zero_offset;
+    // Time the span has been returned to the pool, if scavenging.
+    uint64_t time;
+  };
+
+  // Marks a pooled span as already purged by the scavenger.
+  static const uint64_t kPurged = ~static_cast<uint64_t>(0);
+
+#ifdef SCALLOC_HUGE_PAGES
+  // A span whose whole huge page has been returned to the system. Its
+  // metadata lives outside of the span, as writing a header would fault in
+  // the whole huge page again. Entries are never freed but recycled.
+  struct ReleasedSpan {
+    // Used by the stacks.
+    ReleasedSpan* next;
+    void* span;
+    size_t zero_offset;
+  };
+#endif  // SCALLOC_HUGE_PAGES
+
   always_inline int32_t limit() { return limit_.load(); }
+  always_inline std::atomic<uint64_t>* OccupancyWord(int32_t node,
+                                                     int32_t slot,
+                                                     int32_t backend);
+  always_inline void MarkOccupied(int32_t node, int32_t slot, int32_t backend);
+  always_inline void* PopBackend(int32_t node, int32_t slot, int32_t backend);
+  always_inline void* Steal(int32_t node, int32_t slot, int32_t home);
+  always_inline void* StealFrom(int32_t node,
+                                int32_t slot,
+                                int32_t victim,
+                                int32_t home);
+  always_inline bool Purge(void* p, size_t len);
+#ifdef SCALLOC_HUGE_PAGES
+  always_inline bool Release(int32_t node, void* p);
+  always_inline void* Reuse(int32_t node, size_t* zero_offset);
+#endif  // SCALLOC_HUGE_PAGES
+  always_inline int32_t CurrentNode();
+  always_inline int32_t NodeOf(void* p);
 
   // The currently announced number of threads.
   std::atomic<int32_t> current_threads_;
@@ -59,12 +134,32 @@ class SpanPool {
 
   UNUSED uint8_t pad_[64 - ((sizeof(limit_) + sizeof(current_threads_))  % 64)];  // NOLINT
 
-  Backend* spans_[kSizeClassSlots];
+  // Number of NUMA nodes that have their own backends.
+  int32_t nodes_;
+
+  std::atomic<bool> scavenging_;
+  std::atomic<int32_t> purge_;
+
+  Backend* spans_[kMaxNodes][kSizeClassSlots];
+
+  // Occupancy hints, one bitmap of occupancy_words_ words per node and slot.
+  // The bit of a backend is set after pushing to it and cleared when popping
+  // from it fails. Stealing only visits backends whose bit is set.
+  std::atomic<uint64_t>* occupied_[kMaxNodes];
+  int32_t occupancy_words_;
+
+#ifdef SCALLOC_HUGE_PAGES
+  // Released spans per node, and entries that currently hold no span.
+  Stack<64> released_[kMaxNodes];
+  Stack<64> spare_entries_;
+#endif  // SCALLOC_HUGE_PAGES
+
+  // Always counted, as madvise is a system call anyways.
+  std::atomic<uint64_t> nr_madvise_;
 
 #ifdef PROFILE
   std::atomic<int32_t> nr_allocate_;
   std::atomic<int32_t> nr_free_;
-  std::atomic<int32_t> nr_madvise_;
 #endif  // PROFILE
 };
 
@@ -72,15 +167,67 @@ class SpanPool {
 void SpanPool::Init() {
   current_threads_ = 0;
   limit_ = 0;
+  scavenging_ = false;
+  purge_ = kPurgeStrategy;
+  const char* env = getenv("SCALLOC_PURGE");
+  if (env != nullptr) {
+    if (strcmp(env, "dontneed") == 0) {
+      purge_ = SCALLOC_PURGE_DONTNEED;
+    } else if (strcmp(env, "free") == 0) {
+      purge_ = SCALLOC_PURGE_FREE;
+    } else if (strcmp(env, "none") == 0) {
+      purge_ = SCALLOC_PURGE_NONE;
+    } else {
+      LOG(kWarning, "unknown purge strategy: %s", env);
+    }
+  }
+  nr_madvise_ = 0;
 #ifdef PROFILE
   nr_allocate_ = 0;
   nr_free_ = 0;
-  nr_madvise_ = 0;
 #endif  // PROFILE
-  for (size_t i = 0; i < kSizeClassSlots; i++) {
-    spans_[i] = reinterpret_cast<Backend*>(
-        SystemMmapFail(sizeof(Backend) * CpusOnline()));
+#ifdef SCALLOC_NUMA
+  nodes_ = object_space.nodes();
+#else
+  nodes_ = 1;
+#endif  // SCALLOC_NUMA
+  occupancy_words_ = (CpusOnline() + 63) / 64;
+  for (int32_t node = 0; node < nodes_; node++) {
+    for (size_t i = 0; i < kSizeClassSlots; i++) {
+      spans_[node][i] = reinterpret_cast<Backend*>(
+          SystemMmapFail(sizeof(Backend) * CpusOnline()));
+    }
+    occupied_[node] = reinterpret_cast<std::atomic<uint64_t>*>(
+        SystemMmapFail(sizeof(std::atomic<uint64_t>) * kSizeClassSlots *
+                       occupancy_words_));
+#ifdef SCALLOC_HUGE_PAGES
+    released_[node].SetTop(nullptr);
+#endif  // SCALLOC_HUGE_PAGES
+  }
+#ifdef SCALLOC_HUGE_PAGES
+  spare_entries_.SetTop(nullptr);
+#endif  // SCALLOC_HUGE_PAGES
+}
+
+
+int32_t SpanPool::CurrentNode() {
+#ifdef SCALLOC_NUMA
+  if (nodes_ > 1) {
+    return CurrentNumaNode() % nodes_;
   }
+#endif  // SCALLOC_NUMA
+  return 0;
+}
+
+
+// The node whose backends hold a span, i.e., the node the span's memory is
+// bound to.
+int32_t SpanPool::NodeOf(void* p) {
+#ifdef SCALLOC_NUMA
+  return object_space.NodeOf(p);
+#else
+  return 0;
+#endif  // SCALLOC_NUMA
 }
 
 
@@ -106,7 +253,9 @@ void SpanPool::AnnounceLeavingThread() {
 }
 
 
-void*  SpanPool::Allocate(size_t size_class, int32_t id) {
+// Returns a span for the given size class. zero_offset receives the offset
+// within the span from which on memory is known to be zero.
+void*  SpanPool::Allocate(size_t size_class, int32_t id, size_t* zero_offset) {
 #ifdef PROFILE
   nr_allocate_.fetch_add(1);
 #endif  // PROFILE
@@ -119,36 +268,44 @@ void*  SpanPool::Allocate(size_t size_class, int32_t id) {
   } else {
     size_class_slot = size_class - kFineClasses;
   }
+  const int32_t node = CurrentNode();
+  const int32_t home = id % limit();
   int32_t i = size_class_slot;
-  void* s = spans_[size_class_slot][id % limit()].Pop();
-  for (size_t _i = 0; (s == nullptr) && (_i < kSizeClassSlots); _i++) {
-    i  = size_class_slot - _i;
-    if (i < 0) { i += kSizeClassSlots; }
-
-    const uint64_t start = hwrand() % limit();
-    LOG(kTrace, "start: %lu", start);
-    for (int_fast32_t _j = 0; (_j < limit()) && (s == nullptr); _j++) {
-      s = spans_[i][(start + _j) % limit()].Pop();
+  void* s = PopBackend(node, size_class_slot, home);
+  // Steal from the local node first, and only then from remote nodes.
+  for (int32_t _n = 0; (s == nullptr) && (_n < nodes_); _n++) {
+    for (size_t _i = 0; (s == nullptr) && (_i < kSizeClassSlots); _i++) {
+      i  = size_class_slot - _i;
+      if (i < 0) { i += kSizeClassSlots; }
+      s = Steal((node + _n) % nodes_, i, home);
     }
   }
 
   if (s == NULL) {
-    s =  object_space.AllocateVirtualSpan();
+#ifdef SCALLOC_HUGE_PAGES
+    // Released spans come before fresh ones, so that the object space does
+    // not grow while they are available.
+    s = Reuse(node, zero_offset);
+#endif  // SCALLOC_HUGE_PAGES
   } else {
+    *zero_offset = reinterpret_cast<PooledSpan*>(s)->zero_offset;
 #if defined(SCALLOC_MADVISE) && !defined(SCALLOC_MADVISE_EAGER)
     // madvise for any of the non-fine size classes
     if ((i > 0) && (ClassToSpanSize[i + kFineClasses] > ClassToSpanSize[size_class])) {
-      madvise(
-          reinterpret_cast<void*>(
-              reinterpret_cast<uintptr_t>(s) + ClassToSpanSize[size_class]),
-          kVirtualSpanSize - ClassToSpanSize[size_class],
-          MADV_DONTNEED);
-#ifdef PROFILE
-      nr_madvise_.fetch_add(1);
-#endif  // PROFILE
+      Purge(reinterpret_cast<void*>(
+                reinterpret_cast<uintptr_t>(s) + ClassToSpanSize[size_class]),
+            kVirtualSpanSize - ClassToSpanSize[size_class]);
     }
 #endif  // MADVISE && !MADVISE_EAGER
   }
+  if (s == NULL) {
+#ifdef SCALLOC_NUMA
+    s =  object_space.AllocateVirtualSpan(node);
+#else
+    s =  object_space.AllocateVirtualSpan();
+#endif  // SCALLOC_NUMA
+    *zero_offset = 0;
+  }
 #if defined(SCALLOC_STRICT_PROTECT)
   if (mprotect(
           s,
@@ -167,16 +324,16 @@ void SpanPool::Free(size_t size_class, void* p, int32_t id) {
 #endif  // PROFILE
   LOG(kTrace, "span pool put %p, size class: %lu", p, size_class);
   ScallocAssert(limit() != 0);
+  reinterpret_cast<PooledSpan*>(p)->zero_offset = kVirtualSpanSize;
+  const bool scavenging = scavenging_.load(std::memory_order_relaxed);
+  reinterpret_cast<PooledSpan*>(p)->time = scavenging ? MonotonicTimeMs() : 0;
 #if defined(SCALLOC_MADVISE) && defined(SCALLOC_MADVISE_EAGER)
-  if (size_class >= 17) {
-    madvise(
-        reinterpret_cast<void*>(
-            reinterpret_cast<uintptr_t>(p) + kPageSize),
-        kVirtualSpanSize - kPageSize,
-        MADV_DONTNEED);
-#ifdef PROFILE
-    nr_madvise_.fetch_add(1);
-#endif  // PROFILE
+  if ((size_class >= 17) && !scavenging) {
+    if (Purge(reinterpret_cast<void*>(
+                  reinterpret_cast<uintptr_t>(p) + kPageSize),
+              kVirtualSpanSize - kPageSize)) {
+      reinterpret_cast<PooledSpan*>(p)->zero_offset = kPageSize;
+    }
   }
 #endif  // MADVISE && MADVISE_EAGER
   if (size_class  <= kFineClasses) {
@@ -192,7 +349,256 @@ void SpanPool::Free(size_t size_class, void* p, int32_t id) {
     Fatal("mprotect failed");
   }
 #endif  // SCALLOC_STRICT_PROTECT
-  spans_[size_class][id % limit()].Push(p);
+  const int32_t node = NodeOf(p);
+  const int32_t backend = id % limit();
+  spans_[node][size_class][backend].Push(p);
+  MarkOccupied(node, size_class, backend);
+}
+
+
+std::atomic<uint64_t>* SpanPool::OccupancyWord(int32_t node,
+                                               int32_t slot,
+                                               int32_t backend) {
+  return &occupied_[node][slot * occupancy_words_ + backend / 64];
+}
+
+
+void SpanPool::MarkOccupied(int32_t node, int32_t slot, int32_t backend) {
+  std::atomic<uint64_t>* word = OccupancyWord(node, slot, backend);
+  const uint64_t bit = 1UL << (backend % 64);
+  // Only write the shared word if the bit actually changes.
+  if ((word->load() & bit) == 0) {
+    word->fetch_or(bit);
+  }
+}
+
+
+// Pops a span from a backend, clearing the backend's occupancy bit if it is
+// empty.
+void* SpanPool::PopBackend(int32_t node, int32_t slot, int32_t backend) {
+  void* s = spans_[node][slot][backend].Pop();
+  if (s != nullptr) {
+    return s;
+  }
+  std::atomic<uint64_t>* word = OccupancyWord(node, slot, backend);
+  const uint64_t bit = 1UL << (backend % 64);
+  if ((word->load() & bit) != 0) {
+    word->fetch_and(~bit);
+    // A span pushed before clearing may have found the bit still set. Since
+    // pushing comes before checking the bit, it is visible by now.
+    if (!spans_[node][slot][backend].Empty()) {
+      MarkOccupied(node, slot, backend);
+    }
+  }
+  return nullptr;
+}
+
+
+// Takes a span from any backend of a slot that is marked as occupied,
+// starting at a random one.
+void* SpanPool::Steal(int32_t node, int32_t slot, int32_t home) {
+  const int32_t words = (limit() + 63) / 64;
+  const uint64_t start = hwrand();
+  const int32_t start_bit = start % 64;
+  for (int32_t _w = 0; _w < words; _w++) {
+    const int32_t w = (start / 64 + _w) % words;
+    const uint64_t occupied =
+        occupied_[node][slot * occupancy_words_ + w].load(
+            std::memory_order_relaxed);
+    // Visit the bits from start_bit upwards first, then the lower ones.
+    uint64_t bits[2] = {
+      occupied & (~0UL << start_bit),
+      occupied & ~(~0UL << start_bit)
+    };
+    for (int32_t _b = 0; _b < 2; _b++) {
+      while (bits[_b] != 0) {
+        const int32_t backend = w * 64 + __builtin_ctzl(bits[_b]);
+        bits[_b] &= bits[_b] - 1;
+        void* s = StealFrom(node, slot, backend, home);
+        if (s != nullptr) {
+          return s;
+        }
+      }
+    }
+  }
+  return nullptr;
+}
+
+
+// Returns a span of the victim backend and moves up to kSpanPoolStealBatch - 1
+// more spans to the home backend, so that the next allocations find them
+// there.
+void* SpanPool::StealFrom(int32_t node,
+                          int32_t slot,
+                          int32_t victim,
+                          int32_t home) {
+  void* s = PopBackend(node, slot, victim);
+  if ((s == nullptr) || (victim == home)) {
+    return s;
+  }
+  void* batch_start = nullptr;
+  void* batch_end = nullptr;
+  int32_t len = 0;
+  void* next;
+  while ((len < (kSpanPoolStealBatch - 1)) &&
+         ((next = PopBackend(node, slot, victim)) != nullptr)) {
+    reinterpret_cast<PooledSpan*>(next)->next = batch_start;
+    batch_start = next;
+    if (batch_end == nullptr) {
+      batch_end = next;
+    }
+    len++;
+  }
+  if (len > 0) {
+    spans_[node][slot][home].PushRange(batch_start, batch_end, len);
+    MarkOccupied(node, slot, home);
+  }
+  return s;
+}
+
+int32_t SpanPool::Scavenge(uint64_t now, uint64_t decay, int32_t budget) {
+  int32_t calls = 0;
+#ifdef SCALLOC_MADVISE
+  if (purge_.load() == SCALLOC_PURGE_NONE) {
+    return calls;
+  }
+  for (int32_t node = 0; node < nodes_; node++) {
+    for (size_t i = 0; i < kSizeClassSlots; i++) {
+      for (int32_t j = 0; (j < limit()) && (calls < budget); j++) {
+        Backend* backend = &spans_[node][i][j];
+        if (backend->Empty()) {
+          continue;
+        }
+        // Take the whole backend while madvising, so that no span is handed
+        // out in the meantime. Allocating threads may fall back to other
+        // backends or fresh spans. Other threads keep popping the backend, so
+        // its tag has to keep advancing.
+        void* chain = backend->TakeAll();
+
+        void* keep_start = nullptr;
+        void* keep_end = nullptr;
+        int32_t keep_len = 0;
+        while (chain != nullptr) {
+          PooledSpan* s = reinterpret_cast<PooledSpan*>(chain);
+          chain = s->next;
+          // Spans with a zero offset of at most a page have already been
+          // returned to the system (or have never been touched).
+          if ((calls < budget) &&
+              (s->zero_offset > kPageSize) &&
+              (s->time != kPurged) &&
+              ((now - s->time) >= decay)) {
+#ifdef SCALLOC_HUGE_PAGES
+            // Purging all but the header would split the huge page. Instead,
+            // the whole span is returned and kept out of the backends.
+            if (Release(node, s)) {
+              calls++;
+              continue;
+            }
+            // Out of memory for the entry, keep the span as it is.
+#else
+            if (Purge(reinterpret_cast<void*>(
+                          reinterpret_cast<uintptr_t>(s) + kPageSize),
+                      kVirtualSpanSize - kPageSize)) {
+              s->zero_offset = kPageSize;
+            }
+            s->time = kPurged;
+            calls++;
+#endif  // SCALLOC_HUGE_PAGES
+          }
+          s->next = keep_start;
+          keep_start = s;
+          if (keep_end == nullptr) {
+            keep_end = s;
+          }
+          keep_len++;
+        }
+        if (keep_start != nullptr) {
+          backend->PushRange(keep_start, keep_end, keep_len);
+          // Pops in the meantime may have found the backend empty.
+          MarkOccupied(node, i, j);
+        }
+      }
+    }
+  }
+#endif  // SCALLOC_MADVISE
+  return calls;
+}
+
+#ifdef SCALLOC_HUGE_PAGES
+// Returns the whole memory of a span that is not in any backend to the system
+// and records it as released. Returns false if no entry could be allocated,
+// in which case the span is left untouched.
+bool SpanPool::Release(int32_t node, void* p) {
+  ReleasedSpan* entry = reinterpret_cast<ReleasedSpan*>(spare_entries_.Pop());
+  if (entry == nullptr) {
+    entry = reinterpret_cast<ReleasedSpan*>(
+        core_space.Allocate(sizeof(ReleasedSpan)));
+    if (entry == nullptr) {
+      return false;
+    }
+  }
+  entry->span = p;
+  entry->zero_offset = Purge(p, kVirtualSpanSize) ? 0 : kVirtualSpanSize;
+  released_[node].Push(entry);
+  return true;
+}
+
+
+// Returns a released span, preferably of the given node, or nullptr if there
+// is none. Like for fresh spans, zero_offset is 0 in the latter case.
+void* SpanPool::Reuse(int32_t node, size_t* zero_offset) {
+  *zero_offset = 0;
+  ReleasedSpan* entry = nullptr;
+  for (int32_t _n = 0; (entry == nullptr) && (_n < nodes_); _n++) {
+    entry = reinterpret_cast<ReleasedSpan*>(
+        released_[(node + _n) % nodes_].Pop());
+  }
+  if (entry == nullptr) {
+    return nullptr;
+  }
+  void* p = entry->span;
+  *zero_offset = entry->zero_offset;
+  spare_entries_.Push(entry);
+  return p;
+}
+#endif  // SCALLOC_HUGE_PAGES
+
+
+int SpanPool::SetPurgeStrategy(int strategy) {
+  if ((strategy != SCALLOC_PURGE_DONTNEED) &&
+      (strategy != SCALLOC_PURGE_FREE) &&
+      (strategy != SCALLOC_PURGE_NONE)) {
+    return 0;
+  }
+  purge_ = strategy;
+  return 1;
+}
+
+
+// Returns the memory to the system according to the purge strategy. Returns
+// true if the memory is known to be zero afterwards, which only holds for
+// MADV_DONTNEED.
+bool SpanPool::Purge(void* p, size_t len) {
+  const int32_t strategy = purge_.load(std::memory_order_relaxed);
+  if (strategy == SCALLOC_PURGE_NONE) {
+    return false;
+  }
+  nr_madvise_.fetch_add(1, std::memory_order_relaxed);
+#ifdef MADV_FREE
+  if (strategy == SCALLOC_PURGE_FREE) {
+    if (madvise(p, len, MADV_FREE) == 0) {
+      return false;
+    }
+    if (errno != EINVAL) {
+      return false;
+    }
+    // Kernel does not support MADV_FREE.
+    LOG(kWarning, "MADV_FREE not supported, falling back to MADV_DONTNEED");
+    purge_ = SCALLOC_PURGE_DONTNEED;
+  }
+#endif  // MADV_FREE
+  madvise(p, len, MADV_DONTNEED);
+  return true;
 }
 
 }  // namespace scalloc
@@ -25,15 +25,16 @@ class Stack {
  public:
   always_inline Stack() : top_(TaggedValue<void*>(nullptr, 0)) { }
   always_inline void Push(void* p);
-  always_inline void PushRange(void* p_start, void* p_end);
+  always_inline int32_t PushRange(void* p_start, void* p_end, int32_t len);
   always_inline void* Pop();
   always_inline void PopAll(void** elements, int32_t* len);
+  always_inline void* TakeAll();
   always_inline int_fast32_t Length();
 
   always_inline void SetTop(void* p);
 
   always_inline bool Empty() {
-    return top_.load() == TaggedValue<void*>(NULL, 0);
+    return top_.load().value() == NULL;
   }
 
   always_inline int32_t PushReturnTag(void* p);
@@ -75,13 +76,17 @@ void Stack<PAD>::Push(void* p) {
 }
 
 
+// Pushes a pre-linked list of len elements, starting at p_start and ending at
+// p_end, using a single CAS. Returns the new tag, i.e., the length iff there
+// have not been any pop() operations in between.
 template<int PAD>
-void Stack<PAD>::PushRange(void* p_start, void* p_end) {
+int32_t Stack<PAD>::PushRange(void* p_start, void* p_end, int32_t len) {
   TopPtr top_old;
   do {
     top_old = top_.load();
     *(reinterpret_cast<void**>(p_end)) = top_old.value();
-  } while (!top_.swap(top_old, TopPtr(p_start, top_old.tag() + 1)));
+  } while (!top_.swap(top_old, TopPtr(p_start, top_old.tag() + len)));
+  return top_old.tag() + len;
 }
 
 
@@ -117,6 +122,23 @@ void Stack<PAD>::PopAll(void** elements, int32_t* len) {
 }
 
 
+// Like PopAll(), but advances the tag instead of resetting it. Resetting the tag
+// lets a stalled Pop() succeed on a stale top once the same element is pushed
+// again with the same tag, so use this on stacks that are popped concurrently.
+// The tag is no longer the length of the stack afterwards.
+template<int PAD>
+void* Stack<PAD>::TakeAll() {
+  TopPtr top_old;
+  do {
+    top_old = top_.load();
+    if (top_old.value() == NULL) {
+      return NULL;
+    }
+  } while (!top_.swap(top_old, TopPtr(NULL, top_old.tag() + 1)));
+  return top_old.value();
+}
+
+
 // Returns the length of the list returned iff there have not been any pop()
 // operations in between.
 template<int PAD>
@@ -0,0 +1,137 @@
+// Copyright (c) 2015, the scalloc project authors.  All rights reserved.
+// Please see the AUTHORS file for details.  Use of this source code is governed
+// by a BSD license that can be found in the LICENSE file.
+
+#ifndef SCALLOC_STATS_H_
+#define SCALLOC_STATS_H_
+
+#include <stdint.h>
+
+#include <atomic>
+
+#include "globals.h"
+#include "platform/globals.h"
+#include "scalloc.h"
+
+namespace scalloc {
+
+static_assert(kNumClasses <= SCALLOC_STATS_MAX_CLASSES,
+              "size classes do not fit into scalloc_stats");
+
+// A counter that is only modified by a single thread at a time, but may be
+// read by any thread. Avoids atomic read-modify-write instructions.
+class StatsCounter {
+ public:
+  always_inline void Add(uint64_t n) {
+    value_.store(value_.load(std::memory_order_relaxed) + n,
+                 std::memory_order_relaxed);
+  }
+
+  always_inline uint64_t Get() {
+    return value_.load(std::memory_order_relaxed);
+  }
+
+ private:
+  std::atomic<uint64_t> value_;
+};
+
+
+// Counters of a core. Cores live in zeroed memory and are never destroyed, so
+// counters of terminated threads are kept and continue once a core is reused.
+struct CoreStats {
+  // Objects allocated from and freed to spans, and the bytes requested by the
+  // allocations. Objects in per-CPU caches count as allocated. Counters updated
+  // together share a cache line.
+  struct {
+    StatsCounter objects;
+    StatsCounter requested_bytes;
+  } allocs[kNumClasses];
+  StatsCounter frees[kNumClasses];
+  StatsCounter local_frees;
+  StatsCounter remote_frees;
+
+  // Spans acquired from the span pool (new), from the core's reusable spans
+  // (reused), and from terminated cores (adopted). Spans are deleted by
+  // whichever core frees their last object.
+  StatsCounter spans_new[kNumClasses];
+  StatsCounter spans_deleted[kNumClasses];
+  StatsCounter spans_reused;
+  StatsCounter spans_adopted;
+
+  // State transitions of spans, from which the number of spans per state is
+  // derived: spans become hot when created or revived, and floating once their
+  // owner moves on. Linked spans wait in the reusable spans of their owner.
+  StatsCounter spans_revived[kNumClasses];
+  StatsCounter spans_floated[kNumClasses];
+  StatsCounter spans_linked[kNumClasses];
+  StatsCounter spans_unlinked[kNumClasses];
+
+  // Links all core stats for aggregation.
+  CoreStats* next;
+};
+
+
+class Statistics {
+ public:
+  // Globally constructed, hence we use staged construction.
+  always_inline Statistics() {}
+  always_inline ~Statistics() {}
+
+  always_inline void Init();
+
+  // Registers the stats of a new core. Stats are never unregistered.
+  always_inline void Register(CoreStats* stats);
+
+  // Large objects are served by the system (or the large object cache) anyways,
+  // so their counters are shared.
+  always_inline void AddLargeObject(int64_t bytes) {
+    large_objects_.fetch_add(1, std::memory_order_relaxed);
+    large_allocs_.fetch_add(1, std::memory_order_relaxed);
+    large_bytes_.fetch_add(bytes, std::memory_order_relaxed);
+  }
+
+  always_inline void RemoveLargeObject(int64_t bytes) {
+    large_objects_.fetch_sub(1, std::memory_order_relaxed);
+    large_frees_.fetch_add(1, std::memory_order_relaxed);
+    large_bytes_.fetch_sub(bytes, std::memory_order_relaxed);
+  }
+
+  always_inline void ResizeLargeObject(int64_t delta) {
+    large_bytes_.fetch_add(delta, std::memory_order_relaxed);
+  }
+
+  // Sums up the counters of all cores. Counters are read while being updated,
+  // so the result is only consistent once all threads are quiescent.
+  void Collect(struct scalloc_stats* stats);
+
+  // Prints collected statistics to stderr.
+  void Print();
+
+ private:
+  std::atomic<CoreStats*> head_;
+  std::atomic<int64_t> large_objects_;
+  std::atomic<int64_t> large_bytes_;
+  std::atomic<uint64_t> large_allocs_;
+  std::atomic<uint64_t> large_frees_;
+};
+
+
+void Statistics::Init() {
+  head_ = nullptr;
+  large_objects_ = 0;
+  large_bytes_ = 0;
+  large_allocs_ = 0;
+  large_frees_ = 0;
+}
+
+
+void Statistics::Register(CoreStats* stats) {
+  CoreStats* head = head_.load();
+  do {
+    stats->next = head;
+  } while (!head_.compare_exchange_weak(head, stats));
+}
+
+}  // namespace scalloc
+
+#endif  // SCALLOC_STATS_H_
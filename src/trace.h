@@ -0,0 +1,349 @@
+// Copyright (c) 2015, the scalloc project authors.  All rights reserved.
+// Please see the AUTHORS file for details.  Use of this source code is governed
+// by a BSD license that can be found in the LICENSE file.
+
+#ifndef SCALLOC_TRACE_H_
+#define SCALLOC_TRACE_H_
+
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <semaphore.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <atomic>
+
+#include "arena.h"
+#include "globals.h"
+#include "lock.h"
+#include "log.h"
+#include "platform/globals.h"
+#include "scalloc.h"
+#include "utils.h"
+
+namespace scalloc {
+
+#ifdef SCALLOC_TRACE
+
+// Records every allocation operation to <SCALLOC_TRACE>.<pid>.trace, for
+// replaying it later on (see benchmarks/trace_replay.cc).
+//
+// Each thread appends records to its own ring buffer without synchronization
+// other than publishing the tail. A writer thread drains all rings whenever one
+// is half full and periodically otherwise. A thread finding its ring full
+// drains it itself, so tracing never drops records and also works when the
+// writer does not run (yet). Rings of terminated threads are reused by new
+// threads, which get a new thread number.
+//
+// Child processes are not traced, as they would share the trace file.
+class Tracer {
+ public:
+  // Globally constructed, hence we use staged construction.
+  always_inline Tracer() {}
+  always_inline ~Tracer() {}
+
+  // Opens the trace file if the environment variable SCALLOC_TRACE is set.
+  always_inline void Init();
+
+  // Starts the writer thread, hence has to be called once the allocator is up.
+  always_inline void StartWriter();
+
+  always_inline bool enabled() {
+    return enabled_.load(std::memory_order_relaxed);
+  }
+
+  always_inline void Record(uint16_t op,
+                            void* object,
+                            void* old_object,
+                            size_t size,
+                            size_t alignment);
+
+  // Writes out all buffered records.
+  inline void Flush();
+
+ private:
+  static const int32_t kBufferRecords = 4096;
+  static const int64_t kWriteIntervalNs = 100 * 1000 * 1000;
+
+  struct Buffer {
+    Buffer* next;
+    std::atomic<bool> in_use;
+    uint32_t thread;
+    // Records [head, tail) are waiting to be written. Only the owning thread
+    // moves the tail, and only the holder of the drain lock moves the head.
+    std::atomic<uint64_t> head;
+    std::atomic<uint64_t> tail;
+    scalloc_trace_record records[kBufferRecords];
+  };
+
+  typedef SpinLock<64> Lock;
+
+  static void* RunWriter(void* arg);
+  static void ReleaseBuffer(void* buffer);
+  static void DisableInChild();
+
+  static always_inline uint64_t NowNs() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return static_cast<uint64_t>(ts.tv_sec) * 1000000000UL + ts.tv_nsec;
+  }
+
+  always_inline Buffer* GetBuffer();
+  inline Buffer* AcquireBuffer();
+  inline void Drain(Buffer* b);
+  inline void Write(const void* data, size_t len);
+
+  static TLS_ATTRIBUTE Buffer* buffer_;
+
+  std::atomic<bool> enabled_;
+  int fd_;
+  uint64_t start_;
+  pthread_key_t key_;
+  sem_t write_requests_;
+  std::atomic<uint32_t> threads_;
+  std::atomic<Buffer*> buffers_;
+
+  UNUSED uint8_t pad_[64 - ((sizeof(enabled_) +
+                             sizeof(fd_) +
+                             sizeof(start_) +
+                             sizeof(key_) +
+                             sizeof(write_requests_) +
+                             sizeof(threads_) +
+                             sizeof(buffers_)) % 64)];
+
+  Lock drain_lock_;
+};
+
+
+TLS_ATTRIBUTE Tracer::Buffer* Tracer::buffer_ = nullptr;
+
+
+void Tracer::Init() {
+  enabled_ = false;
+  threads_ = 0;
+  buffers_ = nullptr;
+  const char* prefix = getenv("SCALLOC_TRACE");
+  if (prefix == nullptr) {
+    return;
+  }
+  char path[512];
+  snprintf(path, sizeof(path), "%s.%d.trace", prefix, getpid());
+  fd_ = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+  if (fd_ < 0) {
+    LOG(kWarning, "trace: cannot open %s: %s", path, strerror(errno));
+    return;
+  }
+  if ((sem_init(&write_requests_, 0, 0) != 0) ||
+      (pthread_key_create(&key_, ReleaseBuffer) != 0)) {
+    LOG(kWarning, "trace: cannot set up tracing");
+    close(fd_);
+    return;
+  }
+  scalloc_trace_header header;
+  memset(&header, 0, sizeof(header));
+  header.magic = SCALLOC_TRACE_MAGIC;
+  header.version = SCALLOC_TRACE_VERSION;
+  header.record_size = sizeof(scalloc_trace_record);
+  start_ = NowNs();
+  enabled_ = true;
+  Write(&header, sizeof(header));
+}
+
+
+void Tracer::StartWriter() {
+  if (!enabled()) {
+    return;
+  }
+  pthread_atfork(nullptr, nullptr, DisableInChild);
+  pthread_t thread;
+  if (pthread_create(&thread, nullptr, RunWriter, this) != 0) {
+    LOG(kWarning, "trace: failed to start writer, threads write themselves");
+    return;
+  }
+  pthread_detach(thread);
+}
+
+
+void Tracer::Record(uint16_t op,
+                    void* object,
+                    void* old_object,
+                    size_t size,
+                    size_t alignment) {
+  Buffer* b = GetBuffer();
+  if (UNLIKELY(b == nullptr)) {
+    return;
+  }
+  const uint64_t tail = b->tail.load(std::memory_order_relaxed);
+  const uint64_t head = b->head.load(std::memory_order_acquire);
+  if (UNLIKELY((tail - head) == kBufferRecords)) {
+    Lock::Guard guard(drain_lock_);
+    Drain(b);
+  }
+  scalloc_trace_record* r = &b->records[tail % kBufferRecords];
+  r->timestamp = NowNs() - start_;
+  r->object = reinterpret_cast<uintptr_t>(object);
+  r->old_object = reinterpret_cast<uintptr_t>(old_object);
+  r->size = size;
+  r->thread = b->thread;
+  r->op = op;
+  r->alignment_shift = (alignment > 1) ? Log2(alignment) : 0;
+  b->tail.store(tail + 1, std::memory_order_release);
+  if (UNLIKELY((tail + 1 - head) == (kBufferRecords / 2))) {
+    sem_post(&write_requests_);
+  }
+}
+
+
+Tracer::Buffer* Tracer::GetBuffer() {
+  if (LIKELY(buffer_ != nullptr)) {
+    return buffer_;
+  }
+  return AcquireBuffer();
+}
+
+
+Tracer::Buffer* Tracer::AcquireBuffer() {
+  Buffer* b = buffers_.load();
+  for (; b != nullptr; b = b->next) {
+    bool in_use = false;
+    if (!b->in_use.load() && b->in_use.compare_exchange_strong(in_use, true)) {
+      break;
+    }
+  }
+  if (b == nullptr) {
+    b = reinterpret_cast<Buffer*>(core_space.Allocate(sizeof(Buffer)));
+    if (b == nullptr) {
+      return nullptr;
+    }
+    // Core space is fresh zeroed memory.
+    b->in_use = true;
+    Buffer* top = buffers_.load();
+    do {
+      b->next = top;
+    } while (!buffers_.compare_exchange_weak(top, b));
+  }
+  b->thread = threads_.fetch_add(1);
+  // Set before registering the destructor, which may allocate.
+  buffer_ = b;
+  pthread_setspecific(key_, b);
+  return b;
+}
+
+
+void Tracer::ReleaseBuffer(void* buffer) {
+  // Records of the thread are still written, the buffer just gets a new owner.
+  buffer_ = nullptr;
+  reinterpret_cast<Buffer*>(buffer)->in_use.store(false);
+}
+
+
+void Tracer::DisableInChild() {
+  tracer.enabled_ = false;
+}
+
+
+void Tracer::Flush() {
+  if (!enabled()) {
+    return;
+  }
+  Lock::Guard guard(drain_lock_);
+  for (Buffer* b = buffers_.load(); b != nullptr; b = b->next) {
+    Drain(b);
+  }
+}
+
+
+void Tracer::Drain(Buffer* b) {
+  uint64_t head = b->head.load(std::memory_order_relaxed);
+  const uint64_t tail = b->tail.load(std::memory_order_acquire);
+  while (head != tail) {
+    const uint64_t start = head % kBufferRecords;
+    uint64_t n = tail - head;
+    if ((start + n) > static_cast<uint64_t>(kBufferRecords)) {
+      n = kBufferRecords - start;
+    }
+    Write(&b->records[start], n * sizeof(scalloc_trace_record));
+    head += n;
+  }
+  b->head.store(head, std::memory_order_release);
+}
+
+
+void Tracer::Write(const void* data, size_t len) {
+  const char* p = reinterpret_cast<const char*>(data);
+  while (len > 0) {
+    const ssize_t n = write(fd_, p, len);
+    if (n < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      LOG(kWarning, "trace: write failed, tracing disabled: %s",
+          strerror(errno));
+      enabled_ = false;
+      return;
+    }
+    p += n;
+    len -= n;
+  }
+}
+
+
+void* Tracer::RunWriter(void* arg) {
+  Tracer* self = reinterpret_cast<Tracer*>(arg);
+  while (self->enabled()) {
+    struct timespec deadline;
+    clock_gettime(CLOCK_REALTIME, &deadline);
+    deadline.tv_nsec += kWriteIntervalNs;
+    if (deadline.tv_nsec >= 1000000000L) {
+      deadline.tv_sec++;
+      deadline.tv_nsec -= 1000000000L;
+    }
+    sem_timedwait(&self->write_requests_, &deadline);
+    self->Flush();
+  }
+  return nullptr;
+}
+
+#endif  // SCALLOC_TRACE
+
+
+// Hooks of the allocation entry points. Allocations are recorded after they
+// succeeded, frees before the object is handed back.
+
+always_inline void TraceAllocation(uint16_t op,
+                                   void* object,
+                                   size_t size,
+                                   size_t alignment) {
+#ifdef SCALLOC_TRACE
+  if (UNLIKELY(tracer.enabled()) && (object != nullptr)) {
+    tracer.Record(op, object, nullptr, size, alignment);
+  }
+#endif  // SCALLOC_TRACE
+}
+
+
+always_inline void TraceRealloc(void* old_object, void* object, size_t size) {
+#ifdef SCALLOC_TRACE
+  if (UNLIKELY(tracer.enabled()) && (object != nullptr)) {
+    tracer.Record(SCALLOC_TRACE_REALLOC, object, old_object, size, 0);
+  }
+#endif  // SCALLOC_TRACE
+}
+
+
+always_inline void TraceFree(void* object) {
+#ifdef SCALLOC_TRACE
+  if (UNLIKELY(tracer.enabled()) && (object != nullptr)) {
+    tracer.Record(SCALLOC_TRACE_FREE, object, nullptr, 0, 0);
+  }
+#endif  // SCALLOC_TRACE
+}
+
+}  // namespace scalloc
+
+#endif  // SCALLOC_TRACE_H_
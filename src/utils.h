@@ -6,6 +6,7 @@
 #define SCALLOC_UTILS_H_
 
 #include <sys/mman.h>
+#include <time.h>
 
 #include "globals.h"
 #include "platform/globals.h"
@@ -106,6 +107,18 @@ always_inline uint_fast64_t hwrand() {
 }
 
 
+// Coarse monotonic time in milliseconds.
+always_inline uint64_t MonotonicTimeMs() {
+  struct timespec ts;
+#ifdef CLOCK_MONOTONIC_COARSE
+  clock_gettime(CLOCK_MONOTONIC_COARSE, &ts);
+#else
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+#endif  // CLOCK_MONOTONIC_COARSE
+  return static_cast<uint64_t>(ts.tv_sec) * 1000 + ts.tv_nsec / 1000000;
+}
+
+
 // Used for pseudorand
 const uint32_t kA = 16807;
 const uint32_t kM = 2147483647;
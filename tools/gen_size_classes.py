@@ -0,0 +1,200 @@
+#!/usr/bin/env python
+#
+# Copyright (c) 2015, the scalloc project authors.  All rights reserved.
+# Please see the AUTHORS file for details.  Use of this source code is governed
+# by a BSD license that can be found in the LICENSE file.
+
+"""Generates src/size_classes_raw.h.
+
+Usage: tools/gen_size_classes.py <geometry> [<geometry>...] > src/size_classes_raw.h
+
+The first geometry is the default one, all others are selected at compile time
+using SCALLOC_SIZE_CLASSES_<GEOMETRY> (see the size_classes flag in
+scalloc.gyp). Geometries:
+
+  huge   Small classes every 16B up to 256B, medium classes at every power of
+         two up to 1MiB.
+  dense  Small classes as in huge, medium classes at 4 sizes per power of two
+         up to 1MiB, i.e., at most 20% internal fragmentation. Medium spans
+         hold as many objects as needed to keep the unused tail of a span
+         below 1/64 of its size.
+
+Size classes are emitted as V(class, object size, span size, objects). Small
+classes place objects right after the span header, medium classes start at an
+offset of one object (see BLOCK_OFFSET in src/glue.cc).
+"""
+
+from __future__ import print_function
+
+import sys
+
+PAGE_SIZE = 4096
+SPAN_HEADER_SIZE = 128
+VIRTUAL_SPAN_SIZE = 2 * 1024 * 1024
+MIN_ALIGNMENT = 16
+MAX_SMALL_SIZE = 256
+MAX_MEDIUM_SIZE = 1024 * 1024
+SMALL_SPAN_SIZE = 32768
+# Granularity of the lookup tables used by SizeToClass() (src/size_classes.h):
+# Class sizes up to MAX_SMALL_LOOKUP_SIZE have to be multiples of
+# MIN_ALIGNMENT, larger ones have to be a multiple of a quarter of their power
+# of two.
+MAX_SMALL_LOOKUP_SIZE = 1024
+MEDIUM_LOOKUP_STEPS = 4
+# Tail waste that dense spans are allowed to have.
+MAX_TAIL_WASTE = 1.0 / 64
+
+
+def round_up(n, multiple):
+  return (n + multiple - 1) // multiple * multiple
+
+
+def small_classes():
+  return [(size, SMALL_SPAN_SIZE)
+          for size in range(MIN_ALIGNMENT, MAX_SMALL_SIZE + 1, MIN_ALIGNMENT)]
+
+
+def medium_objects(size):
+  """Objects per span of the power-of-two class that size falls into."""
+  pow2 = 1
+  while pow2 < size:
+    pow2 *= 2
+  if pow2 < 4096:
+    return 64
+  if pow2 < 16384:
+    return 32
+  if pow2 < 131072:
+    return 16
+  return MAX_MEDIUM_SIZE // pow2
+
+
+def medium_span_size(size, objects):
+  return round_up((objects + 1) * size, PAGE_SIZE)
+
+
+def tail_waste(size, objects):
+  span_size = medium_span_size(size, objects)
+  return float(span_size - (objects + 1) * size) / span_size
+
+
+def dense_objects(size):
+  """Objects per span bounding the tail waste, keeping at least as many
+  objects as huge does, and at most twice as many."""
+  base = medium_objects(size)
+  best = base
+  for objects in range(base, 2 * base + 1):
+    if medium_span_size(size, objects) > VIRTUAL_SPAN_SIZE:
+      break
+    if tail_waste(size, objects) <= MAX_TAIL_WASTE:
+      return objects
+    if tail_waste(size, objects) < tail_waste(size, best):
+      best = objects
+  return best
+
+
+def huge():
+  classes = []
+  size = MAX_SMALL_SIZE * 2
+  while size <= MAX_MEDIUM_SIZE:
+    classes.append((size, medium_objects(size)))
+    size *= 2
+  return classes
+
+
+def dense():
+  classes = []
+  pow2 = MAX_SMALL_SIZE
+  while pow2 < MAX_MEDIUM_SIZE:
+    for i in range(1, 5):
+      size = pow2 + i * pow2 // 4
+      classes.append((size, dense_objects(size)))
+    pow2 *= 2
+  return classes
+
+
+GEOMETRIES = {
+  'huge': huge,
+  'dense': dense,
+}
+
+
+def check(name, medium):
+  for size, objects in medium:
+    assert size % MIN_ALIGNMENT == 0, (name, size)
+    if size > MAX_SMALL_LOOKUP_SIZE:
+      pow2 = 1
+      while pow2 * 2 < size:
+        pow2 *= 2
+      assert size % (pow2 // MEDIUM_LOOKUP_STEPS) == 0, (name, size)
+    assert medium_span_size(size, objects) <= VIRTUAL_SPAN_SIZE, (name, size)
+  sizes = [size for size, _ in medium]
+  assert sizes == sorted(sizes) and sizes[-1] == MAX_MEDIUM_SIZE, name
+
+
+def emit_classes(name, medium):
+  small = small_classes()
+  print('const int32_t kNumClasses = %d;' % (1 + len(small) + len(medium)))
+  print('')
+  print('#define FOR_ALL_SIZE_CLASSES(V) \\')
+  lines = ['V(0, 0, 0, 0)']
+  sc = 1
+  for size, span_size in small:
+    lines.append('V(%d, %d, %d, (%d - kSpanHeaderSize)/%d)' %
+                 (sc, size, span_size, span_size, size))
+    sc += 1
+  for size, objects in medium:
+    lines.append('V(%d, %d, ((%d + 1) * %d + kPageSize - 1)/kPageSize * '
+                 'kPageSize, %d)' % (sc, size, objects, size, objects))
+    sc += 1
+  for i, line in enumerate(lines):
+    end = ' \\' if i < len(lines) - 1 else ''
+    print('  %s /* NOLINT */%s' % (line, end))
+
+
+def main(argv):
+  names = argv[1:]
+  if not names or any(name not in GEOMETRIES for name in names):
+    sys.stderr.write('usage: %s <%s>...\n' %
+                     (argv[0], '|'.join(sorted(GEOMETRIES))))
+    return 1
+  print("""\
+// Copyright (c) 2015, the scalloc Project Authors.  All rights reserved.
+// Please see the AUTHORS file for details.  Use of this source code is governed
+// by a BSD license that can be found in the LICENSE file.
+
+//
+//                          +----------------+
+//                          |  DO NOT EDIT!  |
+//                          +----------------+
+//
+// This file is auto-generated using ``tools/gen_size_classes.py %s''
+
+#ifndef SCALLOC_SIZE_CLASSES_RAW_H_
+#define SCALLOC_SIZE_CLASSES_RAW_H_
+
+const int32_t kSpanHeaderSize = %d;
+""" % (' '.join(names), SPAN_HEADER_SIZE))
+  # The default geometry goes last, into the #else branch.
+  ordered = names[1:] + names[:1]
+  for i, name in enumerate(ordered):
+    medium = GEOMETRIES[name]()
+    check(name, medium)
+    if len(ordered) > 1:
+      if i == 0:
+        print('#if defined(SCALLOC_SIZE_CLASSES_%s)' % name.upper())
+      elif i < len(ordered) - 1:
+        print('#elif defined(SCALLOC_SIZE_CLASSES_%s)' % name.upper())
+      else:
+        print('#else  // %s' % name)
+      print('')
+    emit_classes(name, medium)
+    print('')
+  if len(ordered) > 1:
+    print('#endif')
+    print('')
+  print('#endif  // SCALLOC_SIZE_CLASSES_RAW_H_')
+  return 0
+
+
+if __name__ == '__main__':
+  sys.exit(main(sys.argv))
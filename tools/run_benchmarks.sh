@@ -0,0 +1,59 @@
+#!/bin/bash
+
+# Runs the allocator benchmarks against the system allocator and scalloc (and
+# any other allocator given as name=/path/to/lib.so in ALLOCATORS), for each of
+# the given thread counts, and prints throughput and peak RSS per run.
+#
+# Usage: tools/run_benchmarks.sh [threads...]
+#   e.g. BUILDTYPE=Release ALLOCATORS="jemalloc=/usr/lib/libjemalloc.so" \
+#        tools/run_benchmarks.sh 1 2 4 8
+
+BUILDTYPE=${BUILDTYPE:-Release}
+OUT="./out/${BUILDTYPE}"
+THREADS=${*:-"1 $(nproc)"}
+ALLOCATORS="system= scalloc=${OUT}/lib.target/libscalloc.so ${ALLOCATORS}"
+
+if [[ ! -f "${OUT}/lib.target/libscalloc.so" ]]; then
+  echo "${OUT}/lib.target/libscalloc.so not found, build with BUILDTYPE=${BUILDTYPE} make"
+  exit 1
+fi
+
+# Arguments of each benchmark, except for the number of threads which comes
+# first. Sized to run about a second each on a single core.
+BENCHMARKS=(
+  "threadtest 100 100000 8"
+  "larson 20 100000 1000 8 1000"
+  "shbench 1000 1000 1 1000"
+  "cache_thrash 1000 10000 8"
+  "cache_scratch 1000 10000 8"
+  "prod_cons 2000000 1024 8 256"
+  "linux_scalability 10000000 512"
+  "span_pool_steal 3000 256 65536"
+  "span_reuse 20000 1024 64"
+  "numa_locality 8000 1024 64"
+)
+
+printf "%-18s %-10s %8s %14s %14s\n" \
+    "benchmark" "allocator" "threads" "Mops/s" "peak rss KiB"
+for benchmark in "${BENCHMARKS[@]}"; do
+  name=${benchmark%% *}
+  args=${benchmark#* }
+  for threads in ${THREADS}; do
+    # prod_cons takes pairs of threads. span_reuse and numa_locality hand
+    # objects to other threads, and thus need at least two.
+    n=${threads}
+    if [[ ${name} = "prod_cons" ]]; then
+      n=$(( (threads + 1) / 2 ))
+    elif [[ ${name} = "span_reuse" || ${name} = "numa_locality" ]]; then
+      n=$(( threads < 2 ? 2 : threads ))
+    fi
+    for allocator in ${ALLOCATORS}; do
+      lib=${allocator#*=}
+      result=$(LD_PRELOAD=${lib} ${OUT}/${name} ${n} ${args} | tail -n 1)
+      mops=$(echo "${result}" | sed -n 's/.*throughput: \([0-9.]*\).*/\1/p')
+      rss=$(echo "${result}" | sed -n 's/.*peak rss: \([0-9]*\).*/\1/p')
+      printf "%-18s %-10s %8s %14s %14s\n" \
+          "${name}" "${allocator%%=*}" "${threads}" "${mops}" "${rss}"
+    done
+  done
+done